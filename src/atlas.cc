@@ -0,0 +1,271 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "atlas.h"
+#include "log.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+   // lastUse of slots that are never evicted
+   constexpr const uint32_t Pinned = UINT32_MAX;
+
+} // namespace
+
+namespace zutty
+{
+   // Out-of-line definitions, as these are bound by reference (std::min)
+   constexpr int GlyphAtlas::Max_Glyphs;
+   constexpr int GlyphAtlas::Page_Size;
+
+   GlyphAtlas::GlyphAtlas (const std::vector <Font*>& fonts_)
+      : fonts (fonts_)
+      , px (fonts_ [0]->getPx ())
+      , py (fonts_ [0]->getPy ())
+   {
+      /* Compute nx and ny so that the atlas geometry is closest to a
+       * square, with room for all the glyphs of the primary font (plus
+       * the blank glyph at (0,0)), up to Max_Glyphs.
+       */
+      const unsigned n_glyphs =
+         std::min (fonts [0]->getNumGlyphs () + 1, Max_Glyphs);
+      unsigned long total_pixels = n_glyphs * px * py;
+      double side = sqrt (total_pixels);
+      nx = std::max (1.0, side / px);
+      ny = std::max (1.0, side / py);
+      while ((unsigned) nx * ny < n_glyphs)
+      {
+         if (px * nx < py * ny)
+            ++nx;
+         else
+            ++ny;
+      }
+
+      if (nx > 255 || ny > 255)
+      {
+         logE << "Atlas geometry not addressable by single byte coords. "
+              << "Please report this as a bug with your font attached!"
+              << std::endl;
+         throw std::runtime_error ("Impossible atlas geometry");
+      }
+
+      const int nSlots = std::min <int> (nx * ny, Max_Glyphs);
+      logT << "Atlas texture geometry: " << nx << "x" << ny
+           << " glyphs of " << px << "x" << py << " each, "
+           << "yielding pixel size " << nx*px << "x" << ny*py
+           << "; " << nSlots << " glyph slots for "
+           << fonts [0]->getNumGlyphs () << " glyphs in the font."
+           << std::endl;
+
+      layers.resize (fonts.size ());
+      for (auto& layer: layers)
+         layer.assign (nx * px * ny * py, 0);
+
+      map.resize (256 * Page_Size);
+      pageChanged.assign (256, 0);
+      slotOf.assign (256 * 256, 0);
+      absent.assign (256 * 256, 0);
+      codeOf.assign (nSlots, 0);
+      slotListed.assign (nSlots, 0);
+      prev.assign (nSlots, 0);
+      next.assign (nSlots, 0);
+      lastUse.assign (nSlots, 0);
+
+      posMissing = posOf (load (Missing_Glyph_Marker, true));
+      posReplacement = posOf (load (Unicode_Replacement_Character, true));
+      for (uint16_t c = 0x20; c < 0x7f; ++c)
+         load (c, true);
+
+      for (int c = 0; c < 256 * 256; ++c)
+         map [c] = slotOf [c] ? posOf (slotOf [c]) : fallback (c);
+
+      logT << "Atlas: " << loadedSlots.size () << " glyphs preloaded"
+           << std::endl;
+      discardChanges ();
+   }
+
+   void
+   GlyphAtlas::takeChanges (std::vector <uint16_t>& loadedSlots_,
+                            std::vector <uint8_t>& changedPages)
+   {
+      for (uint16_t slot: loadedSlots)
+         slotListed [slot] = 0;
+      loadedSlots_.clear ();
+      loadedSlots.swap (loadedSlots_);
+
+      changedPages.clear ();
+      for (int page = 0; page < 256; ++page)
+      {
+         if (pageChanged [page])
+         {
+            changedPages.push_back (page);
+            pageChanged [page] = 0;
+         }
+      }
+   }
+
+   void
+   GlyphAtlas::discardChanges ()
+   {
+      for (uint16_t slot: loadedSlots)
+         slotListed [slot] = 0;
+      loadedSlots.clear ();
+      std::fill (pageChanged.begin (), pageChanged.end (), 0);
+   }
+
+   // private methods
+
+   GlyphAtlas::Pos
+   GlyphAtlas::posOf (uint16_t slot) const
+   {
+      Pos pos;
+      pos.x = slot % nx;
+      pos.y = slot / nx;
+      return pos;
+   }
+
+   GlyphAtlas::Pos
+   GlyphAtlas::fallback (uint16_t c) const
+   {
+      return ((c >= 0xd800 && c < 0xe000) || c >= 0xfffe)
+         ? posReplacement
+         : posMissing;
+   }
+
+   void
+   GlyphAtlas::touch (uint16_t slot)
+   {
+      if (lastUse [slot] == Pinned)
+         return;
+
+      lastUse [slot] = frame;
+      unlink (slot);
+      link (slot);
+   }
+
+   // Insert slot at the head of the list (as most recently used)
+   void
+   GlyphAtlas::link (uint16_t slot)
+   {
+      prev [slot] = 0;
+      next [slot] = next [0];
+      prev [next [0]] = slot;
+      next [0] = slot;
+   }
+
+   void
+   GlyphAtlas::unlink (uint16_t slot)
+   {
+      next [prev [slot]] = next [slot];
+      prev [next [slot]] = prev [slot];
+   }
+
+   // Load the glyph of c into a free or evicted slot; return the slot,
+   // or 0 if c has no glyph or there is no slot to be had in this frame
+   uint16_t
+   GlyphAtlas::load (uint16_t c, bool pin)
+   {
+      if (!fonts [0]->hasGlyph (c))
+      {
+         absent [c] = 1;
+         return 0;
+      }
+
+      uint16_t slot;
+      if (nextFree < codeOf.size ())
+      {
+         slot = nextFree++;
+      }
+      else
+      {
+         slot = prev [0]; // least recently used
+         if (slot == 0 || lastUse [slot] == frame)
+         {
+            logT << "Atlas: no slot left for glyph " << c
+                 << " in this frame" << std::endl;
+            return 0;
+         }
+
+         if (nEvicted++ == 0)
+         {
+            logT << "Atlas: full, evicting least recently used glyphs"
+                 << std::endl;
+         }
+         unlink (slot);
+         const uint16_t old = codeOf [slot];
+         slotOf [old] = 0;
+         map [old] = fallback (old);
+         pageChanged [old / Page_Size] = 1;
+      }
+
+      rasterize (c, slot);
+      codeOf [slot] = c;
+      slotOf [c] = slot;
+      map [c] = posOf (slot);
+      pageChanged [c / Page_Size] = 1;
+      if (!slotListed [slot])
+      {
+         slotListed [slot] = 1;
+         loadedSlots.push_back (slot);
+      }
+
+      if (pin)
+      {
+         lastUse [slot] = Pinned;
+      }
+      else
+      {
+         lastUse [slot] = frame;
+         link (slot);
+      }
+      return slot;
+   }
+
+   // Render the glyph of c into slot of each layer
+   void
+   GlyphAtlas::rasterize (uint16_t c, uint16_t slot)
+   {
+      const int stride = nx * px;
+      const Pos pos = posOf (slot);
+      const size_t offset = pos.y * py * stride + pos.x * px;
+
+      for (size_t k = 0; k < fonts.size (); ++k)
+      {
+         uint8_t* dst = layers [k].data () + offset;
+
+         // Copy the glyph of the same font in an earlier layer, or of the
+         // primary font if this one does not have it
+         size_t src = 0;
+         while (src < k && fonts [src] != fonts [k])
+            ++src;
+         if (src == k && k > 0 && !fonts [k]->hasGlyph (c))
+            src = 0;
+
+         if (src == k)
+         {
+            fonts [k]->rasterize (c, dst, stride);
+         }
+         else
+         {
+            const uint8_t* from = layers [src].data () + offset;
+            for (int j = 0; j < py; ++j)
+               memcpy (dst + j * stride, from + j * stride, px);
+         }
+      }
+   }
+
+} // namespace zutty
@@ -0,0 +1,148 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "font.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace zutty
+{
+   /* Atlas of glyphs rasterized on demand.
+    *
+    * The atlas is a grid of glyph slots, with a layer of pixel data per
+    * font (e.g. Regular, Bold, Italic, BoldItalic); a slot holds the
+    * glyph of the same code point in every layer. The first font is the
+    * primary: the set of code points with glyphs is the one it has; the
+    * other fonts fall back to its glyphs where they lack one.
+    *
+    * Slot (0,0) is kept blank. The "missing glyph" and "replacement
+    * character" glyphs (referenced by code points without a glyph, just
+    * like before) and the printable ASCII range are preloaded and kept
+    * loaded. Any other glyph is loaded when first looked up; once the
+    * atlas is full, the least recently used glyph is evicted to make
+    * room for it.
+    *
+    * The atlas is meant to be used by a single CharVdev, which uploads
+    * the changes (see takeChanges ()) into its own copy if need be.
+    */
+   class GlyphAtlas
+   {
+   public:
+      // Glyph slot in the atlas grid
+      struct Pos
+      {
+         uint8_t x = 0;
+         uint8_t y = 0;
+      };
+      static_assert (sizeof (Pos) == 2, "GlyphAtlas::Pos size mismatch");
+
+      // The atlas will hold no more glyphs than this
+      static constexpr int Max_Glyphs = 8192;
+
+      // The fonts must stay loaded as long as the atlas is in use
+      explicit GlyphAtlas (const std::vector <Font*>& fonts);
+
+      uint16_t getPx () const { return px; };
+      uint16_t getPy () const { return py; };
+      uint16_t getNx () const { return nx; };
+      uint16_t getNy () const { return ny; };
+      int getNumLayers () const { return layers.size (); };
+      int getStride () const { return nx * px; }; // layer width in pixels
+
+      const uint8_t* getLayerData (int layer) const
+      {
+         return layers [layer].data ();
+      };
+
+      /* Mapping of all code points to the slots of their glyphs, or those
+       * of the missing glyph or replacement character (or to the blank
+       * slot). Glyphs are only guaranteed to be in the atlas for the code
+       * points looked up since the last call of beginFrame ().
+       *
+       * The map is a flat table indexed by code point, laid out just like
+       * the 256x256 mapping texture: each page of Page_Size entries (code
+       * points sharing their high byte) is a row of the texture.
+       */
+      const std::vector <Pos>& getMap () const { return map; };
+
+      static constexpr int Page_Size = 256;
+
+      /* Start a new frame: glyphs looked up from now on are kept in the
+       * atlas until the next call (unless that would need more slots than
+       * there are, in which case the excess glyphs are mapped as missing).
+       */
+      void beginFrame () { ++frame; };
+
+      // Load the glyph of code point c unless it is in the atlas
+      void lookup (uint16_t c)
+      {
+         const uint16_t slot = slotOf [c];
+         if (slot)
+         {
+            if (lastUse [slot] != frame)
+               touch (slot);
+         }
+         else if (!absent [c])
+            load (c);
+      }
+
+      /* Slots loaded and map pages changed (in ascending order) since the
+       * last call, to be uploaded.
+       */
+      void takeChanges (std::vector <uint16_t>& loadedSlots,
+                        std::vector <uint8_t>& changedPages);
+
+      // Forget about the changes, for users of the atlas data in place
+      void discardChanges ();
+
+   private:
+      std::vector <Font*> fonts;
+      uint16_t px = 0;
+      uint16_t py = 0;
+      uint16_t nx = 0;
+      uint16_t ny = 0;
+      std::vector <std::vector <uint8_t>> layers;
+
+      std::vector <Pos> map;           // code point -> slot of glyph
+      std::vector <uint16_t> slotOf;   // code point -> slot index, or 0
+      std::vector <uint8_t> absent;    // code point known to have no glyph
+      std::vector <uint16_t> codeOf;   // slot index -> code point
+      Pos posMissing;
+      Pos posReplacement;
+
+      // Slots that can be evicted, as a list in order of recent use
+      // (most recent first), linked via slot indices; 0 is the head.
+      std::vector <uint16_t> prev;
+      std::vector <uint16_t> next;
+      std::vector <uint32_t> lastUse;
+      uint32_t frame = 1;
+      uint16_t nextFree = 1;
+
+      // Slots loaded since the changes were last taken, each listed once,
+      // so the list stays bounded even if they are never taken
+      std::vector <uint16_t> loadedSlots;
+      std::vector <uint8_t> slotListed;
+      std::vector <uint8_t> pageChanged; // per map page
+      uint32_t nEvicted = 0;
+
+      Pos posOf (uint16_t slot) const;
+      Pos fallback (uint16_t c) const;
+      void touch (uint16_t slot);
+      void link (uint16_t slot);
+      void unlink (uint16_t slot);
+      uint16_t load (uint16_t c, bool pin = false);
+      void rasterize (uint16_t c, uint16_t slot);
+   };
+
+} // namespace zutty
@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
@@ -125,4 +126,13 @@ namespace zutty
       return os;
    }
 
+   /* New capacity to hold at least size, with some headroom for growth
+    * (used for buffers reallocated on resizing only when outgrown).
+    */
+   inline int
+   grow (int capacity, int size, int maxSize)
+   {
+      return std::min (std::max (size, capacity + capacity / 4), maxSize);
+   }
+
 } // namespace zutty
@@ -15,6 +15,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstring>
 #include <iostream>
 
 namespace
@@ -85,63 +87,29 @@ namespace
    }
 
    void
-   setupAtlasTexture (const zutty::Font& fnt, int idx)
+   setupAtlasTexture (const zutty::GlyphAtlas& atlas, int idx)
    {
       glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
                       0,    // mipmap level, always zero
                       0, 0, // X and Y offsets into texture area
                       idx,  // layer index offset
-                      fnt.getPx () * fnt.getNx (),
-                      fnt.getPy () * fnt.getNy (),
+                      atlas.getPx () * atlas.getNx (),
+                      atlas.getPy () * atlas.getNy (),
                       1,    // number of layers, i.e., fonts, loaded
-                      GL_RED, GL_UNSIGNED_BYTE, fnt.getAtlasData ());
+                      GL_RED, GL_UNSIGNED_BYTE, atlas.getLayerData (idx));
       glCheckError ();
    }
 
+   // N.B.: the atlas map is laid out just like the mapping texture, with
+   // each code point mapped to the (x, y) bytes of its glyph position
    void
-   setupAtlasMappingTexture (const zutty::Font& fnt,
+   setupAtlasMappingTexture (const zutty::GlyphAtlas& atlas,
                              GLuint target, GLuint& texture)
    {
-      auto atlasMap = std::vector <uint8_t> ();
-      atlasMap.resize (2 * 256 * 256, 0);
-
-      // Pre-fill the mapping texture with references to "missing glyph"
-      // and "replacement character" glyphs, if available in the font atlas.
-      const auto itEnd = fnt.getAtlasMap ().end ();
-
-      zutty::Font::AtlasPos apRC {};
-      {
-         auto rcIt =
-            fnt.getAtlasMap ().find (zutty::Unicode_Replacement_Character);
-         if (rcIt != itEnd)
-            apRC = rcIt->second;
-      }
-
-      zutty::Font::AtlasPos apMG {};
-      {
-         auto mgIt = fnt.getAtlasMap ().find (zutty::Missing_Glyph_Marker);
-         if (mgIt != itEnd)
-            apMG = mgIt->second;
-      }
-
-      for (int k = 0; k < 256 * 256; ++k)
-      {
-         const auto& apos = ((k >= 0xd800 && k < 0xe000) || k >= 0xfffe)
-                          ? apRC
-                          : apMG;
-         atlasMap [2 * k] = apos.x;
-         atlasMap [2 * k + 1] = apos.y;
-      }
-
-      // Fill the mapping texture with supported characters
-      for (auto it = fnt.getAtlasMap ().begin (); it != itEnd; ++it)
-      {
-         atlasMap [2 * it->first] = it->second.x;
-         atlasMap [2 * it->first + 1] = it->second.y;
-      }
       setupTexture (target, GL_TEXTURE_2D, texture);
       glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, 256, 256, 0,
-                   GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, atlasMap.data ());
+                   GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+                   atlas.getMap ().data ());
    }
 
    template <typename T> void
@@ -165,7 +133,67 @@ namespace zutty
    CharVdev::CharVdev (Fontpack* fontpk)
       : px (fontpk->getPx ())
       , py (fontpk->getPy ())
+      , atlas (&fontpk->getAtlas ())
+      , atlas_dw (fontpk->hasDoubleWidth ()
+                  ? &fontpk->getAtlasDoubleWidth ()
+                  : nullptr)
+      , synthStyles (fontpk->synthesizesStyles ())
+      , italicPivot (fontpk->getItalicPivot ())
+   {
+   }
+
+   CharVdev::Mapping::Mapping (CharVdev& vdev_, uint16_t nCols_,
+                               uint16_t nRows_, Cell *& cells_,
+                               std::vector <uint32_t>* dirtyCells_)
+      : vdev (vdev_)
+      , nCols (nCols_)
+      , nRows (nRows_)
+      , cells (cells_)
+      , dirtyCells (dirtyCells_)
+   {
+   };
+
+   CharVdev::Mapping::~Mapping ()
+   {
+      assert (cells != nullptr); // mapping in place
+
+      vdev.unmapCells ();
+      cells = nullptr;
+   };
+
+   CharVdev::Mapping CharVdev::getMapping ()
+   {
+      assert (cells == nullptr); // no mapping in place
+
+      cells = mapCells ();
+      return CharVdev::Mapping (*this, nCols, nRows, cells,
+                                listDirtyCells ? &dirtyCells : nullptr);
+   };
+
+   // Decide which atlas the glyph of a cell is drawn from, just like the
+   // renderers do, and look it up there
+   void
+   CharVdev::loadGlyph (const Cell* row, uint16_t x)
    {
+      const Cell& cell = row [x];
+      if (cell.dwidth_cont) // drawn by the left half
+         return;
+
+      bool dwidth = cell.dwidth;
+      if (dwidth && x < nCols - 1 && !row [x + 1].dwidth_cont)
+         dwidth = false; // invalid without a continuation to the right
+
+      if (!dwidth)
+         atlas->lookup (cell.uc_pt);
+      else if (atlas_dw)
+         atlas_dw->lookup (cell.uc_pt);
+   }
+
+   GLCharVdev::GLCharVdev (Fontpack* fontpk, EglPresenter* presenter_)
+      : CharVdev (fontpk)
+      , presenter (presenter_)
+   {
+      listDirtyCells = true;
       createShaders ();
 
       /*
@@ -204,53 +232,53 @@ namespace zutty
       glUniform2i (compU_glyphSize, px, py);
       glUniform2i (compU_sizeChars, nCols, nRows);
       glUniform1i (compU_showWraps, opts.showWraps ? 1 : 0);
+      glUniform1i (compU_synthStyles, synthStyles ? 1 : 0);
+      glUniform1i (compU_italicPivot, italicPivot);
 
       // Setup atlas texture
       setupTexture (GL_TEXTURE1, GL_TEXTURE_2D_ARRAY, T_atlas);
-      const Font& reg = fontpk->getRegular ();
       glTexStorage3D (GL_TEXTURE_2D_ARRAY, 1, GL_R8,
-                      reg.getPx () * reg.getNx (),
-                      reg.getPy () * reg.getNy (),
-                      4); // number of layers
+                      atlas->getPx () * atlas->getNx (),
+                      atlas->getPy () * atlas->getNy (),
+                      atlas->getNumLayers ());
       glCheckError ();
 
-      setupAtlasTexture (reg, 0);
-      setupAtlasTexture (fontpk->getBold (), 1);
-      setupAtlasTexture (fontpk->getItalic (), 2);
-      setupAtlasTexture (fontpk->getBoldItalic (), 3);
+      for (int k = 0; k < atlas->getNumLayers (); ++k)
+         setupAtlasTexture (*atlas, k);
 
-      setupAtlasMappingTexture (reg, GL_TEXTURE2, T_atlasMap);
+      setupAtlasMappingTexture (*atlas, GL_TEXTURE2, T_atlasMap);
 
       glUniform2fv (compU_ulMetrics, 8, fontpk->getUlMetrics ());
 
       // Setup atlas texture for double-width characters
-      if (fontpk->hasDoubleWidth ())
+      if (atlas_dw)
       {
          hasDoubleWidth = true;
 
          setupTexture (GL_TEXTURE3, GL_TEXTURE_2D_ARRAY, T_atlas_dw);
-         const Font& dw = fontpk->getDoubleWidth ();
          glTexStorage3D (GL_TEXTURE_2D_ARRAY, 1, GL_R8,
-                         dw.getPx () * dw.getNx (),
-                         dw.getPy () * dw.getNy (),
+                         atlas_dw->getPx () * atlas_dw->getNx (),
+                         atlas_dw->getPy () * atlas_dw->getNy (),
                          1); // number of layers
          glCheckError ();
 
-         setupAtlasTexture (dw, 0);
-         setupAtlasMappingTexture (dw, GL_TEXTURE3, T_atlasMap_dw);
+         setupAtlasTexture (*atlas_dw, 0);
+         setupAtlasMappingTexture (*atlas_dw, GL_TEXTURE3, T_atlasMap_dw);
       }
       glUniform1i (compU_hasDoubleWidth, hasDoubleWidth ? 1 : 0);
 
-      // Now that it's all loaded into GL, no need to keep font data in-memory
-      fontpk->releaseFonts ();
+      // Further glyphs are uploaded as they get loaded (see loadGlyphs ())
+      atlas->discardChanges ();
+      if (atlas_dw)
+         atlas_dw->discardChanges ();
    }
 
-   CharVdev::~CharVdev ()
+   GLCharVdev::~GLCharVdev ()
    {
    }
 
    bool
-   CharVdev::resize (uint16_t pxWidth_, uint16_t pxHeight_)
+   GLCharVdev::resize (uint16_t pxWidth_, uint16_t pxHeight_)
    {
       assert (cells == nullptr); // no mapping in place
 
@@ -279,19 +307,52 @@ namespace zutty
 
       glUniform2i (compU_sizeChars, nCols, nRows);
 
-      setupTexture (GL_TEXTURE0, GL_TEXTURE_2D, T_output);
-      glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA8, viewWidth, viewHeight);
-      glBindImageTexture (0, T_output, 0, GL_FALSE, 0, GL_WRITE_ONLY,
-                          GL_RGBA8);
-      glCheckError ();
+      // The output texture and the cell buffer are only reallocated when
+      // growing beyond their current capacity, in which case some headroom
+      // is added, so that interactive resizing mostly gets by without.
+      if (viewWidth > outputCapacity.x || viewHeight > outputCapacity.y)
+      {
+         GLint maxSize;
+         glGetIntegerv (GL_MAX_TEXTURE_SIZE, &maxSize);
+         outputCapacity.x = grow (outputCapacity.x, viewWidth, maxSize);
+         outputCapacity.y = grow (outputCapacity.y, viewHeight, maxSize);
+         logT << "Output texture capacity: " << outputCapacity.x << " x "
+              << outputCapacity.y << " pixels" << std::endl;
+
+         setupTexture (GL_TEXTURE0, GL_TEXTURE_2D, T_output);
+         glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA8,
+                         outputCapacity.x, outputCapacity.y);
+         glBindImageTexture (0, T_output, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                             GL_RGBA8);
+         glCheckError ();
+      }
 
-      setupStorageBuffer <Cell> (0, B_text, nRows * nCols);
+      const int nCells = nRows * nCols;
+      if (nCells > textCapacity)
+      {
+         textCapacity = grow (textCapacity, nCells, INT_MAX / sizeof (Cell));
+         setupStorageBuffer <Cell> (0, B_text, textCapacity);
+      }
+      cellBuf.resize (nCells);
+
+      nTiles = Point ((nCols + compTileSize [0] - 1) / compTileSize [0],
+                      (nRows + compTileSize [1] - 1) / compTileSize [1]);
+      const int nTilesTotal = nTiles.x * nTiles.y;
+      if (nTilesTotal > tilesCapacity)
+      {
+         tilesCapacity = grow (tilesCapacity, nTilesTotal, INT_MAX / 4);
+         setupStorageBuffer <uint32_t> (1, B_tiles, tilesCapacity);
+      }
+      tileListed.assign (nTilesTotal, 0);
+      dirtyTiles.clear ();
+      dirtyCells.clear ();
+      rowOffset = 0;
 
       return true;
    }
 
    void
-   CharVdev::setCursor (const Cursor& cursor)
+   GLCharVdev::setCursor (const Cursor& cursor)
    {
       static uint16_t prevPosX = 0;
       static uint16_t prevPosY = 0;
@@ -300,35 +361,67 @@ namespace zutty
       glUniform3i (compU_cursorColor,
                    cursor.color.red, cursor.color.green, cursor.color.blue);
       glUniform4i (compU_cursorPos, cursor.posX, cursor.posY, prevPosX, prevPosY);
+      cursorPos = Point (cursor.posX, cursor.posY);
+      prevCursorPos = Point (prevPosX, prevPosY);
       prevPosX = cursor.posX;
       prevPosY = cursor.posY;
       glUniform1i (compU_cursorStyle, static_cast <uint8_t> (cursor.style));
    }
 
    void
-   CharVdev::setSelection (const Rect& sel)
+   GLCharVdev::setSelection (const Rect& sel)
    {
       static Rect prev;
-      Rect damage (std::min (sel.tl, prev.tl), std::max (sel.br, prev.br));
-      uint32_t damageStart = nCols * damage.tl.y + damage.tl.x;
-      uint32_t damageEnd = nCols * damage.br.y + damage.br.x + 1;
+      Rect changed (std::min (sel.tl, prev.tl), std::max (sel.br, prev.br));
+      uint32_t damageStart = nCols * changed.tl.y + changed.tl.x;
+      uint32_t damageEnd = nCols * changed.br.y + changed.br.x + 1;
       prev = sel;
 
       glUseProgram (P_compute);
       glUniform4i (compU_selectRect, sel.tl.x, sel.tl.y, sel.br.x, sel.br.y);
       glUniform1i (compU_selectRectMode, static_cast <int> (sel.rectangular));
       glUniform2i (compU_selectDamage, damageStart, damageEnd);
+      selectDamageStart = damageStart;
+      selectDamageEnd = damageEnd;
    }
 
    void
-   CharVdev::setDeltaFrame (bool delta)
+   GLCharVdev::setDeltaFrame (bool delta)
    {
       glUseProgram (P_compute);
       glUniform1i (compU_deltaFrame, delta ? 1 : 0);
+      deltaFrame = delta;
+   }
+
+   /* Instead of moving the pixels of the output texture, the rows stored
+    * in it are rotated: view row y is in texture row (y + rowOffset) mod
+    * nRows. The rows scrolled out of view hold the pixels to be replaced
+    * by the newly exposed rows, so those are forced to be redrawn, as is
+    * the cell the cursor has been scrolled away with.
+    */
+   void
+   GLCharVdev::scrollUp (uint16_t count)
+   {
+      assert (cells != nullptr); // mapping in place
+
+      if (count >= nRows)
+         return;
+
+      const uint32_t keep = (nRows - count) * nCols;
+      std::memmove (cellBuf.data (), cellBuf.data () + count * nCols,
+                    sizeof (Cell) * keep);
+      for (uint32_t idx = keep; idx < cellBuf.size (); ++idx)
+         cellBuf [idx].dirty = 1; // never equal to a cell of the frame
+
+      if (cursorPos.y >= count && cursorPos.x < nCols)
+         cellBuf [nCols * (cursorPos.y - count) + cursorPos.x].dirty = 1;
+
+      rowOffset = (rowOffset + count) % nRows;
+      scrolled = true;
    }
 
    void
-   CharVdev::draw ()
+   GLCharVdev::draw ()
    {
       assert (cells == nullptr); // no mapping in place
 
@@ -346,56 +439,319 @@ namespace zutty
          glActiveTexture (GL_TEXTURE4);
          glBindTexture (GL_TEXTURE_2D, T_atlasMap_dw);
       }
+      glUniform1i (compU_rowOffset, rowOffset);
       glCheckError ();
 
-      glDispatchCompute (nCols, nRows, 1);
+      uploadCells ();
+
+      // N.B.: scrolling moves the rows of the whole view (see scrollUp ())
+      damage.clear ();
+      if (!deltaFrame || scrolled)
+         damage.emplace_back (0, 0, pxWidth, pxHeight);
+      scrolled = false;
+
+      if (deltaFrame)
+      {
+         // Only dispatch the tiles with cells to draw
+         listDirtyTiles ();
+         if (damage.empty ())
+            listDamage ();
+         loadGlyphs ();
+         if (!dirtyTiles.empty ())
+         {
+            glBindBuffer (GL_SHADER_STORAGE_BUFFER, B_tiles);
+            glBufferSubData (GL_SHADER_STORAGE_BUFFER, 0,
+                             sizeof (uint32_t) * dirtyTiles.size (),
+                             dirtyTiles.data ());
+            glDispatchCompute (dirtyTiles.size (), 1, 1);
+         }
+      }
+      else
+      {
+         loadGlyphs ();
+         glDispatchCompute (nTiles.x, nTiles.y, 1);
+      }
       glMemoryBarrier (GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
       glCheckError ();
 
+      for (uint32_t tile: dirtyTiles)
+         tileListed [nTiles.x * (tile >> 16) + (tile & 0xffff)] = 0;
+      dirtyTiles.clear ();
+      dirtyCells.clear ();
+
+      if (damage.empty ())
+         return; // the window already shows this frame
+
+      // Unless the presenter tells otherwise, the whole window is redrawn
+      const Rect area = presenter
+         ? presenter->beginFrame (damage, pxWidth, pxHeight)
+         : Rect (0, 0, pxWidth, pxHeight);
+      const bool scissor = area.tl.x > 0 || area.tl.y > 0 ||
+                           area.br.x < pxWidth || area.br.y < pxHeight;
+      if (scissor)
+      {
+         glEnable (GL_SCISSOR_TEST);
+         glScissor (area.tl.x, pxHeight - area.br.y,
+                    area.br.x - area.tl.x, area.br.y - area.tl.y);
+      }
+
       glUseProgram (P_draw);
       glClearColor (opts.bg.red / 255.0, opts.bg.green / 255.0,
                     opts.bg.blue / 255.0, 1.0);
       glClear (GL_COLOR_BUFFER_BIT);
 
+      glUniform1i (drawU_rowShift, rowOffset * py);
       glActiveTexture (GL_TEXTURE0);
       glBindTexture (GL_TEXTURE_2D, T_output);
 
       glEnableVertexAttribArray (A_pos);
       glEnableVertexAttribArray (A_vertexTexCoord);
       glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+
+      if (scissor)
+         glDisable (GL_SCISSOR_TEST);
    }
 
-   CharVdev::Mapping::Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_)
-      : nCols (nCols_)
-      , nRows (nRows_)
-      , cells (cells_)
+   // private methods
+
+   void
+   GLCharVdev::addDirtyTile (uint16_t x, uint16_t y)
    {
-   };
+      if (x >= nCols || y >= nRows)
+         return;
 
-   CharVdev::Mapping::~Mapping ()
+      const uint16_t tx = x / compTileSize [0];
+      const uint16_t ty = y / compTileSize [1];
+      uint8_t& listed = tileListed [nTiles.x * ty + tx];
+      if (!listed)
+      {
+         listed = 1;
+         dirtyTiles.push_back (ty << 16 | tx);
+      }
+   }
+
+   // Collect the tiles of cells to be drawn in a delta frame: those with
+   // dirty cells, plus the cells of the cursor and the selection damage
+   void
+   GLCharVdev::listDirtyTiles ()
    {
-      assert (cells != nullptr); // mapping in place
+      for (uint32_t idx: dirtyCells)
+         addDirtyTile (idx % nCols, idx / nCols);
 
-      glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
-      cells = nullptr;
-   };
+      addDirtyTile (cursorPos.x, cursorPos.y);
+      addDirtyTile (prevCursorPos.x, prevCursorPos.y);
 
-   CharVdev::Mapping CharVdev::getMapping ()
+      // N.B.: the damage range is signed, just as in the shader
+      const int end = std::min (selectDamageEnd, nCols * nRows);
+      for (int idx = std::max (0, selectDamageStart); idx < end; )
+      {
+         // advance to the next tile on the row, or the start of the next row
+         const int x = idx % nCols;
+         const int nextTileX = (x / compTileSize [0] + 1) * compTileSize [0];
+         addDirtyTile (x, idx / nCols);
+         idx += std::min <int> (nCols, nextTileX) - x;
+      }
+   }
+
+   /* Damage of a delta frame: the pixels of the listed tiles, merged into
+    * a rect per run of consecutive tile rows. A tile might also draw the
+    * right half of a double-width cell starting at its last column.
+    */
+   void
+   GLCharVdev::listDamage ()
    {
-      assert (cells == nullptr); // no mapping in place
+      if (dirtyTiles.empty ())
+         return;
 
-      cells = reinterpret_cast <Cell *> (
-                 glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
-                                   0, sizeof (Cell) * nRows * nCols,
-                                   GL_MAP_READ_BIT | GL_MAP_WRITE_BIT));
+      std::vector <Point> spans (nTiles.y, Point (INT_MAX, -1));
+      for (uint32_t tile: dirtyTiles)
+      {
+         Point& span = spans [tile >> 16];
+         span.x = std::min <int> (span.x, tile & 0xffff);
+         span.y = std::max <int> (span.y, tile & 0xffff);
+      }
 
-      return CharVdev::Mapping (nCols, nRows, cells);
-   };
+      const int tw = compTileSize [0];
+      const int th = compTileSize [1];
+      for (int ty = 0; ty < nTiles.y; )
+      {
+         if (spans [ty].y < 0)
+         {
+            ++ty;
+            continue;
+         }
+
+         Point span = spans [ty];
+         int end = ty + 1;
+         for (; end < nTiles.y && spans [end].y >= 0; ++end)
+         {
+            span.x = std::min (span.x, spans [end].x);
+            span.y = std::max (span.y, spans [end].y);
+         }
+
+         const int x1 = std::min <int> (nCols, (span.y + 1) * tw + 1);
+         const int y1 = std::min <int> (nRows, end * th);
+         damage.emplace_back (opts.border + span.x * tw * px,
+                              opts.border + ty * th * py,
+                              opts.border + x1 * px, opts.border + y1 * py);
+         ty = end;
+      }
+   }
 
-   // private methods
+   // Load the glyphs of the cells to be drawn: in a delta frame, those
+   // the tiles are listed for (see listDirtyTiles ()), else all of them
+   void
+   GLCharVdev::loadGlyphs ()
+   {
+      atlas->beginFrame ();
+      if (atlas_dw)
+         atlas_dw->beginFrame ();
+
+      auto load = [this] (int idx)
+                  {
+                     loadGlyph (cellBuf.data () + idx - idx % nCols,
+                                idx % nCols);
+                  };
+      const int nCells = nCols * nRows;
+      if (deltaFrame)
+      {
+         for (uint32_t idx: dirtyCells)
+            load (idx);
+         for (const Point& cp: {cursorPos, prevCursorPos})
+            if (cp.x < nCols && cp.y < nRows)
+               load (nCols * cp.y + cp.x);
+         const int end = std::min (selectDamageEnd, nCells);
+         for (int idx = std::max (0, selectDamageStart); idx < end; ++idx)
+            load (idx);
+      }
+      else
+      {
+         for (int idx = 0; idx < nCells; ++idx)
+            load (idx);
+      }
+
+      uploadGlyphs (*atlas, GL_TEXTURE1, T_atlas, GL_TEXTURE2, T_atlasMap);
+      if (atlas_dw)
+         uploadGlyphs (*atlas_dw, GL_TEXTURE3, T_atlas_dw,
+                       GL_TEXTURE4, T_atlasMap_dw);
+   }
+
+   // Upload the glyphs loaded into an atlas, and the atlas map entries
+   // changed along with them, since the last upload
+   void
+   GLCharVdev::uploadGlyphs (GlyphAtlas& atl,
+                             GLuint atlasTarget, GLuint atlasTexture,
+                             GLuint mapTarget, GLuint mapTexture)
+   {
+      atl.takeChanges (slots, pages);
+
+      if (!slots.empty ())
+      {
+         const int px = atl.getPx ();
+         const int py = atl.getPy ();
+         const int stride = atl.getStride ();
+         glActiveTexture (atlasTarget);
+         glBindTexture (GL_TEXTURE_2D_ARRAY, atlasTexture);
+         glPixelStorei (GL_UNPACK_ROW_LENGTH, stride);
+         for (uint16_t slot: slots)
+         {
+            const int x = slot % atl.getNx () * px;
+            const int y = slot / atl.getNx () * py;
+            for (int k = 0; k < atl.getNumLayers (); ++k)
+               glTexSubImage3D (GL_TEXTURE_2D_ARRAY, 0, x, y, k, px, py, 1,
+                                GL_RED, GL_UNSIGNED_BYTE,
+                                atl.getLayerData (k) + y * stride + x);
+         }
+         glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+      }
+
+      if (!pages.empty ())
+      {
+         // Upload runs of changed pages (texture rows) straight from the map
+         const auto& map = atl.getMap ();
+         glActiveTexture (mapTarget);
+         glBindTexture (GL_TEXTURE_2D, mapTexture);
+         for (size_t k = 0; k < pages.size (); )
+         {
+            size_t n = 1;
+            while (k + n < pages.size () && pages [k + n] == pages [k] + n)
+               ++n;
+            glTexSubImage2D (GL_TEXTURE_2D, 0, 0, pages [k],
+                             GlyphAtlas::Page_Size, n,
+                             GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+                             &map [pages [k] * GlyphAtlas::Page_Size]);
+            k += n;
+         }
+      }
+      glCheckError ();
+   }
+
+   // N.B.: cells are mapped in cellBuf, to be uploaded by draw () once it
+   // is known whether the frame is a delta frame (see setDeltaFrame ()).
+   CharVdev::Cell *
+   GLCharVdev::mapCells ()
+   {
+      return cellBuf.data ();
+   }
+
+   void
+   GLCharVdev::unmapCells ()
+   {
+   }
 
+   /* Upload the cells to the GPU, without ever reading back from the
+    * buffer. A full frame (or one with scrolling) replaces the whole
+    * buffer contents. For a delta frame, the range from the first to the
+    * last dirty cell is replaced (from cellBuf, which mirrors the buffer),
+    * so the driver need not preserve it, nor wait for the previous
+    * dispatch to finish with it.
+    */
    void
-   CharVdev::createShaders ()
+   GLCharVdev::uploadCells ()
+   {
+      glBindBuffer (GL_SHADER_STORAGE_BUFFER, B_text);
+
+      uint32_t first = 0;
+      uint32_t last = cellBuf.size () - 1;
+      GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+      // N.B.: after scrolling, all the cells are in new positions
+      if (deltaFrame && !scrolled)
+      {
+         if (dirtyCells.empty ())
+            return;
+
+         // Indices are in order, except for overlay cells at the end
+         const auto range = std::minmax_element (dirtyCells.begin (),
+                                                 dirtyCells.end ());
+         first = *range.first;
+         last = *range.second;
+         access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+      }
+
+      const size_t offset = sizeof (Cell) * first;
+      const size_t length = sizeof (Cell) * (last + 1 - first);
+      void* dst = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                    offset, length, access);
+      if (dst)
+      {
+         memcpy (dst, &cellBuf [first], length);
+         glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+      }
+      else
+      {
+         glBufferSubData (GL_SHADER_STORAGE_BUFFER, offset, length,
+                          &cellBuf [first]);
+      }
+
+      // The GPU clears the dirty flag of the cells it draws; do the same
+      // here, so that cellBuf keeps mirroring the buffer.
+      for (uint32_t idx: dirtyCells)
+         cellBuf [idx].dirty = 0;
+   }
+
+   void
+   GLCharVdev::createShaders ()
    {
       GLuint S_compute, S_fragment, S_vertex;
 
@@ -423,6 +779,9 @@ namespace zutty
       compU_deltaFrame = glGetUniformLocation (P_compute, "deltaFrame");
       compU_showWraps = glGetUniformLocation (P_compute, "showWraps");
       compU_hasDoubleWidth = glGetUniformLocation (P_compute, "hasDoubleWidth");
+      compU_rowOffset = glGetUniformLocation (P_compute, "rowOffset");
+      compU_synthStyles = glGetUniformLocation (P_compute, "synthStyles");
+      compU_italicPivot = glGetUniformLocation (P_compute, "italicPivot");
 
       logT << "compute program:"
            << " uniform glyphSize=" << compU_glyphSize
@@ -437,8 +796,15 @@ namespace zutty
            << " deltaFrame=" << compU_deltaFrame
            << " showWraps=" << compU_showWraps
            << " hasDoubleWidth=" << compU_hasDoubleWidth
+           << " rowOffset=" << compU_rowOffset
+           << " synthStyles=" << compU_synthStyles
+           << " italicPivot=" << compU_italicPivot
            << std::endl;
 
+      glGetProgramiv (P_compute, GL_COMPUTE_WORK_GROUP_SIZE, compTileSize);
+      logT << "compute tile size: " << compTileSize [0]
+           << " x " << compTileSize [1] << " cells" << std::endl;
+
       P_draw = glCreateProgram ();
       glAttachShader (P_draw, S_fragment);
       glAttachShader (P_draw, S_vertex);
@@ -448,11 +814,13 @@ namespace zutty
       A_pos = glGetAttribLocation (P_draw, "pos");
       A_vertexTexCoord = glGetAttribLocation (P_draw, "vertexTexCoord");
       drawU_viewPixels = glGetUniformLocation (P_draw, "viewPixels");
+      drawU_rowShift = glGetUniformLocation (P_draw, "rowShift");
 
       logT << "draw program:"
            << " attrib pos=" << A_pos
            << " vertexTexCoord=" << A_vertexTexCoord
            << " uniform viewPixels=" << drawU_viewPixels
+           << " rowShift=" << drawU_rowShift
            << std::endl;
    }
 
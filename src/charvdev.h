@@ -12,6 +12,7 @@
 #pragma once
 
 #include "base.h"
+#include "eglpresent.h"
 #include "fontpack.h"
 #include "gl.h"
 #include "options.h"
@@ -20,18 +21,28 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace zutty
 {
+   /* Character video device: the renderer's view of the display.
+    *
+    * Cells are written via a Mapping, then draw () renders them, along
+    * with cursor and selection, into the window. This class holds what
+    * is common to its implementations (backends): GLCharVdev, rendering
+    * via an OpenGL ES compute shader, and SoftCharVdev, rendering on the
+    * CPU (see softvdev.h).
+    */
    class CharVdev
    {
    public:
       explicit CharVdev (Fontpack* fontpk);
 
-      ~CharVdev ();
+      virtual ~CharVdev () = default;
 
-      bool resize (uint16_t pxWidth_, uint16_t pxHeight_);
-      void draw ();
+      // Set the window size in pixels; return true if it has changed
+      virtual bool resize (uint16_t pxWidth_, uint16_t pxHeight_) = 0;
+      virtual void draw () = 0;
 
       struct Cell
       {
@@ -72,18 +83,27 @@ namespace zutty
 
       static Cell::Ptr make_cells (uint16_t nCols, uint16_t nRows)
       {
-         return std::shared_ptr <Cell> (new Cell [nRows * nCols],
+         return make_cells (nRows * nCols);
+      }
+
+      static Cell::Ptr make_cells (uint32_t count)
+      {
+         return std::shared_ptr <Cell> (new Cell [count],
                                         std::default_delete <Cell []> ());
       }
 
       struct Mapping
       {
-         Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_);
+         Mapping (CharVdev& vdev_, uint16_t nCols_, uint16_t nRows_,
+                  Cell *& cells_, std::vector <uint32_t>* dirtyCells_);
          ~Mapping ();
 
+         CharVdev& vdev;
          uint16_t nCols;
          uint16_t nRows;
          Cell *& cells;
+         // If not null, the indices of cells marked dirty are to be added
+         std::vector <uint32_t>* dirtyCells;
       };
 
       Mapping getMapping ();
@@ -105,17 +125,83 @@ namespace zutty
          Style style = Style::hidden;
       };
 
-      void setCursor (const Cursor& cursor);
-      void setSelection (const Rect& selection);
-      void setDeltaFrame (bool delta);
+      virtual void setCursor (const Cursor& cursor) = 0;
+      virtual void setSelection (const Rect& selection) = 0;
+      virtual void setDeltaFrame (bool delta) = 0;
 
-   private:
+      /* The whole view has scrolled up by count rows since the last frame
+       * drawn. A device may shift what it holds (the mapped cells along
+       * with the rendered pixels) accordingly, so that the delta copy of
+       * the next frame only finds the newly exposed rows changed. Called
+       * with the cells mapped, before the delta copy.
+       */
+      virtual void scrollUp (uint16_t count) {}
+
+      /* The parts of the window changed by the last draw (), in pixels
+       * from the top left corner (bottom right corners excluded). This is
+       * the whole window, unless drawing a delta frame; empty if nothing
+       * has changed at all.
+       */
+      const std::vector <Rect>& getDamage () const { return damage; };
+
+   protected:
       uint16_t px;
       uint16_t py;
-      uint16_t nCols;
-      uint16_t nRows;
-      uint16_t pxWidth;
-      uint16_t pxHeight;
+      uint16_t nCols = 0;
+      uint16_t nRows = 0;
+      uint16_t pxWidth = 0;
+      uint16_t pxHeight = 0;
+
+      Cell * cells = nullptr; // valid pointer if mapped, else nullptr
+
+      // Indices of the cells marked dirty via a Mapping, if the device
+      // keeps track of them (see Mapping::dirtyCells)
+      bool listDirtyCells = false;
+      std::vector <uint32_t> dirtyCells;
+
+      std::vector <Rect> damage; // see getDamage ()
+
+      // Glyph atlases of the Fontpack (atlas_dw if it has double-width)
+      GlyphAtlas* atlas;
+      GlyphAtlas* atlas_dw;
+
+      // Bold and italic to be synthesized (see Fontpack::synthesizesStyles ())
+      bool synthStyles;
+      uint16_t italicPivot;
+
+      /* Make sure the glyph of cell x of a row (of nCols cells) is in its
+       * atlas. To be called for each cell to be drawn, after starting a
+       * new frame in the atlases (see GlyphAtlas::beginFrame ()).
+       */
+      void loadGlyph (const Cell* row, uint16_t x);
+
+      // Make the cell storage of the device accessible for a Mapping
+      virtual Cell * mapCells () = 0;
+      virtual void unmapCells () = 0;
+   };
+
+   /* CharVdev rendering via an OpenGL ES compute shader, in the GL context
+    * current on the calling thread. If constructed with an EglPresenter,
+    * only the damaged part of the window surface is redrawn, as far as
+    * the presenter allows (see eglpresent.h).
+    */
+   class GLCharVdev: public CharVdev
+   {
+   public:
+      explicit GLCharVdev (Fontpack* fontpk, EglPresenter* presenter = nullptr);
+
+      ~GLCharVdev ();
+
+      bool resize (uint16_t pxWidth_, uint16_t pxHeight_) override;
+      void draw () override;
+
+      void setCursor (const Cursor& cursor) override;
+      void setSelection (const Rect& selection) override;
+      void setDeltaFrame (bool delta) override;
+      void scrollUp (uint16_t count) override;
+
+   private:
+      EglPresenter* presenter;
       bool hasDoubleWidth = false;
 
       // GL ids of programs, buffers, textures, attributes and uniforms:
@@ -126,14 +212,52 @@ namespace zutty
       GLuint T_atlas_dw = 0;
       GLuint T_atlasMap_dw = 0;
       GLuint T_output = 0;
+      Point outputCapacity {0, 0}; // allocated size of T_output in pixels
+      int textCapacity = 0;        // allocated size of B_text in cells
       GLint A_pos, A_vertexTexCoord;
       GLint compU_glyphSize, compU_sizeChars, compU_ulMetrics;
       GLint compU_cursorColor, compU_cursorPos, compU_cursorStyle;
       GLint compU_selectRect, compU_selectRectMode, compU_selectDamage;
       GLint compU_deltaFrame, compU_showWraps, compU_hasDoubleWidth;
-      GLint drawU_viewPixels;
+      GLint compU_rowOffset, compU_synthStyles, compU_italicPivot;
+      GLint drawU_viewPixels, drawU_rowShift;
 
-      Cell * cells = nullptr; // valid pointer if mapped, else nullptr
+      // Rows of the output texture are rotated by rowOffset, so that
+      // scrolling does not need to move any pixels (see scrollUp ())
+      uint16_t rowOffset = 0;
+      bool scrolled = false;
+      GLint compTileSize [3]; // cells covered by a compute workgroup
+
+      // Tiles with cells to draw in a delta frame, as (y << 16 | x)
+      GLuint B_tiles = 0;
+      int tilesCapacity = 0;       // allocated size of B_tiles in tiles
+      std::vector <uint32_t> dirtyTiles;
+      std::vector <uint8_t> tileListed;
+      Point nTiles {0, 0};
+      Point cursorPos {0, 0};
+      Point prevCursorPos {0, 0};
+      int selectDamageStart = 0;
+      int selectDamageEnd = 0;
+      bool deltaFrame = false;
+
+      void addDirtyTile (uint16_t x, uint16_t y);
+      void listDirtyTiles ();
+      void listDamage ();
+
+      // Copy of the cells on the GPU, written via a Mapping
+      std::vector <Cell> cellBuf;
+      void uploadCells ();
+
+      // Glyphs loaded into the atlases, and atlas map pages changed
+      std::vector <uint16_t> slots;
+      std::vector <uint8_t> pages;
+      void loadGlyphs ();
+      void uploadGlyphs (GlyphAtlas& atlas,
+                         GLuint atlasTarget, GLuint atlasTexture,
+                         GLuint mapTarget, GLuint mapTexture);
+
+      Cell * mapCells () override;
+      void unmapCells () override;
 
       void createShaders ();
    };
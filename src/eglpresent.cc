@@ -0,0 +1,173 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "eglpresent.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+   using zutty::Rect;
+
+   // Buffers older than this are redrawn in full
+   constexpr const size_t maxBufferAge = 4;
+
+   bool
+   hasExtension (EGLDisplay dpy, const char* name)
+   {
+      const char* exts = eglQueryString (dpy, EGL_EXTENSIONS);
+      const size_t len = strlen (name);
+      for (const char* p = exts; p && (p = strstr (p, name)); p += len)
+      {
+         if ((p == exts || p [-1] == ' ') && (p [len] == ' ' || !p [len]))
+            return true;
+      }
+      return false;
+   }
+
+   Rect
+   boundingBox (const Rect& a, const Rect& b)
+   {
+      if (a.empty ())
+         return b;
+      if (b.empty ())
+         return a;
+      return Rect (std::min (a.tl.x, b.tl.x), std::min (a.tl.y, b.tl.y),
+                   std::max (a.br.x, b.br.x), std::max (a.br.y, b.br.y));
+   }
+
+   uint64_t
+   area (const Rect& r)
+   {
+      return uint64_t (r.br.x - r.tl.x) * (r.br.y - r.tl.y);
+   }
+
+} // namespace
+
+namespace zutty
+{
+   EglPresenter::EglPresenter (EGLDisplay dpy_, EGLSurface surface_)
+      : dpy (dpy_)
+      , surface (surface_)
+   {
+      if (hasExtension (dpy, "EGL_KHR_partial_update"))
+         setDamageRegion = (PFNEGLSETDAMAGEREGIONKHRPROC)
+            eglGetProcAddress ("eglSetDamageRegionKHR");
+
+      if (hasExtension (dpy, "EGL_KHR_swap_buffers_with_damage"))
+         swapWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress ("eglSwapBuffersWithDamageKHR");
+      else if (hasExtension (dpy, "EGL_EXT_swap_buffers_with_damage"))
+         swapWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress ("eglSwapBuffersWithDamageEXT");
+
+      logI << "EglPresenter: partial update "
+           << (setDamageRegion ? "enabled" : "not available")
+           << ", swap with damage "
+           << (swapWithDamage ? "enabled" : "not available") << std::endl;
+   }
+
+   EglPresenter::~EglPresenter ()
+   {
+      if (nFrames)
+      {
+         logI << "EglPresenter: " << nFrames << " frames, presented "
+              << presentedPixels << " of " << windowPixels << " pixels ("
+              << 100 * presentedPixels / windowPixels << "%)" << std::endl;
+      }
+   }
+
+   Rect
+   EglPresenter::beginFrame (const std::vector <Rect>& damage,
+                             uint16_t pxWidth, uint16_t pxHeight)
+   {
+      const Rect full (0, 0, pxWidth, pxHeight);
+      if (winSize.x != pxWidth || winSize.y != pxHeight)
+      {
+         winSize = Point (pxWidth, pxHeight);
+         history.clear ();
+      }
+
+      Rect bbox (0, 0, 0, 0);
+      for (const Rect& r: damage)
+         bbox = boundingBox (bbox, r);
+      history.insert (history.begin (), bbox);
+      if (history.size () > maxBufferAge)
+         history.pop_back ();
+
+      if (!setDamageRegion)
+         return full;
+
+      // The buffer misses the damage of the frames since it was last
+      // presented, besides that of the current frame
+      EGLint age = 0;
+      if (!eglQuerySurface (dpy, surface, EGL_BUFFER_AGE_KHR, &age))
+         age = 0;
+
+      Rect region = full;
+      if (age > 0 && (size_t)age <= history.size ())
+      {
+         region = Rect (0, 0, 0, 0);
+         for (int k = 0; k < age; ++k)
+            region = boundingBox (region, history [k]);
+         region = Rect (std::max (region.tl.x, 0), std::max (region.tl.y, 0),
+                        std::min <int> (region.br.x, pxWidth),
+                        std::min <int> (region.br.y, pxHeight));
+      }
+
+      toEglRects ({region});
+      if (!setDamageRegion (dpy, surface, eglRects.data (), 1))
+      {
+         logW << "eglSetDamageRegionKHR() failed" << std::endl;
+         return full;
+      }
+      return region;
+   }
+
+   void
+   EglPresenter::swapBuffers (const std::vector <Rect>& damage)
+   {
+      const uint64_t winPixels = uint64_t (winSize.x) * winSize.y;
+      ++nFrames;
+      windowPixels += winPixels;
+
+      if (swapWithDamage && !damage.empty ())
+      {
+         toEglRects (damage);
+         swapWithDamage (dpy, surface, eglRects.data (), damage.size ());
+         for (const Rect& r: damage)
+            presentedPixels += area (r);
+      }
+      else
+      {
+         eglSwapBuffers (dpy, surface);
+         presentedPixels += winPixels;
+      }
+   }
+
+   // private methods
+
+   void
+   EglPresenter::toEglRects (const std::vector <Rect>& rects)
+   {
+      eglRects.clear ();
+      for (const Rect& r: rects)
+      {
+         eglRects.push_back (r.tl.x);
+         eglRects.push_back (winSize.y - r.br.y);
+         eglRects.push_back (r.br.x - r.tl.x);
+         eglRects.push_back (r.br.y - r.tl.y);
+      }
+   }
+
+} // namespace zutty
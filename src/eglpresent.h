@@ -0,0 +1,76 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "base.h"
+#include "gl.h"
+
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace zutty
+{
+   /* Presentation of frames drawn by GLCharVdev in an EGL window surface,
+    * limited to the damaged part of the window where the EGL implementation
+    * allows that:
+    * - with EGL_KHR_partial_update, only the damaged area (plus what is
+    *   stale in the buffer, as told by its age) is redrawn;
+    * - with EGL_KHR/EXT_swap_buffers_with_damage, only the damaged rects
+    *   are passed on to the compositor.
+    * Without these, the whole window is redrawn and presented each frame.
+    *
+    * Damage rects are in window pixels from the top left corner, with the
+    * bottom right corner excluded (see CharVdev::getDamage ()).
+    */
+   class EglPresenter
+   {
+   public:
+      EglPresenter (EGLDisplay dpy, EGLSurface surface);
+
+      ~EglPresenter ();
+
+      /* Called by the device before drawing into the surface, with the
+       * damage of the frame; returns the area of the window to be drawn
+       * (which is the whole window unless using partial update).
+       */
+      Rect beginFrame (const std::vector <Rect>& damage,
+                       uint16_t pxWidth, uint16_t pxHeight);
+
+      // Present the frame drawn since beginFrame ()
+      void swapBuffers (const std::vector <Rect>& damage);
+
+   private:
+      EGLDisplay dpy;
+      EGLSurface surface;
+      PFNEGLSETDAMAGEREGIONKHRPROC setDamageRegion = nullptr;
+      PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swapWithDamage = nullptr;
+
+      Point winSize {0, 0};
+
+      // Bounding boxes of the damage of the last frames, newest first,
+      // to find what is stale in a buffer of a given age
+      std::vector <Rect> history;
+
+      // EGL rects (origin at bottom left) passed to the EGL calls
+      std::vector <EGLint> eglRects;
+
+      // Counters of presented pixels, logged on destruction
+      uint64_t nFrames = 0;
+      uint64_t presentedPixels = 0;
+      uint64_t windowPixels = 0;
+
+      void toEglRects (const std::vector <Rect>& rects);
+   };
+
+} // namespace zutty
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
@@ -38,10 +39,6 @@ namespace zutty
       , baseline (priFont.getBaseline ())
       , ulTop (priFont.getUlTop ())
       , ulThick (priFont.getUlThick ())
-      , nx (priFont.getNx ())
-      , ny (priFont.getNy ())
-      , atlasBuf (priFont.getAtlas ())
-      , atlasMap (priFont.getAtlasMap ())
    {
       load ();
    }
@@ -55,9 +52,159 @@ namespace zutty
       load ();
    }
 
+   Font::~Font ()
+   {
+      if (face)
+         FT_Done_Face (face);
+      if (ft)
+         FT_Done_FreeType (ft);
+   }
+
+   bool Font::hasGlyph (uint16_t c) const
+   {
+      return coverage [c / 8] & (1 << (c % 8));
+   }
+
+   void Font::rasterize (uint16_t c, uint8_t* dst, int stride)
+   {
+      const uint8_t* cell = cache->getGlyph (c);
+      if (!cell)
+      {
+         const auto it = newIndex.find (c);
+         if (it != newIndex.end ())
+            cell = newGlyphs.data () + it->second * px * py;
+      }
+      if (cell)
+      {
+         for (int j = 0; j < py; ++j)
+            memcpy (dst + j * stride, cell + j * px, px);
+         return;
+      }
+
+      for (int j = 0; j < py; ++j)
+         std::fill_n (dst + j * stride, px, 0);
+
+      if (!face && !faceFailed)
+      {
+         try
+         {
+            openFace ();
+         }
+         catch (const std::runtime_error& e)
+         {
+            logW << e.what () << std::endl;
+            faceFailed = true;
+         }
+      }
+      if (!face)
+         return;
+
+      if (FT_Load_Char (face, c, FT_LOAD_RENDER))
+      {
+         logW << "FreeType: Failed to load glyph for char " << c
+              << " from " << filename << std::endl;
+         return;
+      }
+
+      // destination pixel offset
+      int dx = face->glyph->bitmap_left;
+      int dy = baseline > 0 ? baseline - face->glyph->bitmap_top : 0;
+
+      // source skip horiz and vert
+      const int sh = std::max (0, -dy);
+      const int sw = std::max (0, -dx);
+      dx += sw;
+      dy += sh;
+
+      // raw/rasterized bitmap dimensions
+      const auto& bmp = face->glyph->bitmap;
+      const int bh = std::min ({(int)bmp.rows - sh, py - dy});
+      const int bw = std::min ({(int)bmp.width - sw, px - dx});
+
+      uint8_t* const write = dst + stride * dy + dx;
+
+      /* Load bitmap into the glyph cell. Each row in the bitmap
+       * occupies bitmap.pitch bytes (with padding); this is the
+       * increment in the input bitmap array per row.
+       *
+       * Interpretation of bytes within the bitmap rows is subject to
+       * bitmap.pixel_mode, essentially either 8 bits (256-scale gray)
+       * per pixel, or 1 bit (mono) per pixel. Leftmost pixel is MSB.
+       *
+       */
+      const uint8_t* bmp_src_row;
+      uint8_t* atl_dst_row;
+      switch (bmp.pixel_mode)
+      {
+      case FT_PIXEL_MODE_MONO:
+         for (int j = sh; j < bh; ++j)
+         {
+            bmp_src_row = bmp.buffer + j * bmp.pitch;
+            atl_dst_row = write + j * stride;
+            uint8_t byte = 0;
+            for (int k = 0; k < bw; ++k)
+            {
+               if (k % 8 == 0)
+                  byte = *bmp_src_row++;
+               if (k >= sw)
+                  *atl_dst_row++ = (byte & 0x80) ? 0xFF : 0;
+               byte <<= 1;
+            }
+         }
+         break;
+      case FT_PIXEL_MODE_GRAY:
+         for (int j = 0; j < bh; ++j)
+         {
+            bmp_src_row = bmp.buffer + (j + sh) * bmp.pitch + sw;
+            atl_dst_row = write + j * stride;
+            for (int k = 0; k < bw; ++k)
+            {
+               *atl_dst_row++ = *bmp_src_row++;
+            }
+         }
+         break;
+      default:
+         logW << "FreeType: Unhandled pixel_type=" << (int)bmp.pixel_mode
+              << " for char " << c << std::endl;
+         break;
+      }
+
+      newIndex [c] = newCodes.size ();
+      newCodes.push_back (c);
+      for (int j = 0; j < py; ++j)
+         newGlyphs.insert (newGlyphs.end (),
+                           dst + j * stride, dst + j * stride + px);
+   }
+
+   void Font::saveCache ()
+   {
+      if (!cacheDirty && newCodes.empty ())
+         return;
+
+      FontCache::Metrics metrics;
+      metrics.px = px;
+      metrics.py = py;
+      metrics.baseline = baseline;
+      metrics.ulTop = ulTop;
+      metrics.ulThick = ulThick;
+      metrics.numGlyphs = numGlyphs;
+      cache->save (metrics, coverage.data (), newCodes, newGlyphs);
+
+      // Serve the saved glyphs from the new cache file
+      auto saved = std::make_unique <FontCache> (filename, cacheKey);
+      if (saved->isValid ())
+      {
+         cache = std::move (saved);
+         cacheDirty = false;
+         newCodes.clear ();
+         newGlyphs.clear ();
+         newIndex.clear ();
+      }
+   }
+
    // private methods
 
-   bool Font::isLoadableChar (FT_ULong c)
+   bool Font::isLoadableChar (FT_ULong c) const
    {
       if (c == Missing_Glyph_Marker)
          return true;
@@ -75,29 +222,74 @@ namespace zutty
 
    void Font::load ()
    {
-      FT_Library ft;
-      FT_Face face;
-
       if (FT_Init_FreeType (&ft))
          throw std::runtime_error ("Could not initialize FreeType library");
       logI << "Loading " << filename << " as "
            << (overlay ? "overlay" : (dwidth ? "double-width" : "primary"))
            << std::endl;
+
+      FT_Int ftMajor, ftMinor, ftPatch;
+      FT_Library_Version (ft, &ftMajor, &ftMinor, &ftPatch);
+      cacheKey.kind = overlay ? 1 : (dwidth ? 2 : 0);
+      cacheKey.fontsize = opts.fontsize;
+      cacheKey.ftVersion = (ftMajor << 16) | (ftMinor << 8) | ftPatch;
+      cacheKey.px = px;
+      cacheKey.py = py;
+      cacheKey.baseline = baseline;
+      cache = std::make_unique <FontCache> (filename, cacheKey);
+
+      if (cache->isValid ())
+      {
+         const FontCache::Metrics& m = cache->getMetrics ();
+         px = m.px;
+         py = m.py;
+         baseline = m.baseline;
+         ulTop = m.ulTop;
+         ulThick = m.ulThick;
+         numGlyphs = m.numGlyphs;
+         coverage.assign (cache->getCoverage (),
+                          cache->getCoverage () + FontCache::Coverage_Size);
+         logI << "Glyph size " << px << "x" << py << " (cached)" << std::endl;
+         return;
+      }
+
+      try
+      {
+         openFace ();
+      }
+      catch (const std::runtime_error&)
+      {
+         FT_Done_FreeType (ft);
+         ft = nullptr;
+         throw;
+      }
+      cacheDirty = true;
+   }
+
+   void Font::openFace ()
+   {
       if (FT_New_Face (ft, filename.c_str (), 0, &face))
+      {
+         face = nullptr;
          throw std::runtime_error (std::string ("Failed to load font ") +
                                    filename);
+      }
 
-      /* Determine the number of glyphs to actually load.
-       * We need this number up front to compute the atlas geometry.
+      /* Count the glyphs that might get loaded, so that the atlas can be
+       * sized accordingly. Nothing is rasterized yet.
        */
-      int num_glyphs = 0;
+      if (coverage.empty ())
       {
+         coverage.assign (FontCache::Coverage_Size, 0);
          FT_UInt gindex;
          FT_ULong charcode = FT_Get_First_Char (face, &gindex);
          while (gindex != 0)
          {
             if (isLoadableChar (charcode))
-               ++ num_glyphs;
+            {
+               coverage [charcode / 8] |= 1 << (charcode % 8);
+               ++ numGlyphs;
+            }
             charcode = FT_Get_Next_Char (face, charcode, &gindex);
          }
       }
@@ -105,83 +297,23 @@ namespace zutty
       logT << "Family: " << face->family_name
            << "; Style: " << face->style_name
            << "; Faces: " << face->num_faces
-           << "; Glyphs: " << num_glyphs << " to load ("
+           << "; Glyphs: " << numGlyphs << " loadable ("
            << face->num_glyphs << " total)"
            << std::endl;
 
-      if (face->num_fixed_sizes > 0)
-         loadFixed (face);
-      else
-         loadScaled (face);
-
-      /* Given that we have num_glyphs glyphs to load, with each
-       * individual glyph having a size of px * py, compute nx and ny so
-       * that the resulting atlas texture geometry is closest to a square.
-       * We use one extra glyph space to guarantee a blank glyph at (0,0).
-       */
-      if (!overlay)
+      try
       {
-         unsigned n_glyphs = num_glyphs + 1;
-         unsigned long total_pixels = n_glyphs * px * py;
-         double side = sqrt (total_pixels);
-         nx = side / px;
-         ny = side / py;
-         while ((unsigned) nx * ny < n_glyphs)
-         {
-            if (px * nx < py * ny)
-               ++nx;
-            else
-               ++ny;
-         }
-
-         if (nx > 255 || ny > 255)
-         {
-            logE << "Atlas geometry not addressable by single byte coords. "
-                 << "Please report this as a bug with your font attached!"
-                 << std::endl;
-            throw std::runtime_error ("Impossible atlas geometry");
-         }
-
-         logT << "Atlas texture geometry: " << nx << "x" << ny
-              << " glyphs of " << px << "x" << py << " each, "
-              << "yielding pixel size " << nx*px << "x" << ny*py << "."
-              << std::endl;
-         logT << "Atlas holds space for " << nx*ny << " glyphs, "
-              << n_glyphs << " will be used, empty: "
-              << nx*ny - n_glyphs << " ("
-              << 100.0 * (nx*ny - n_glyphs) / (nx*ny)
-              << "%)" << std::endl;
-
-         size_t atlas_bytes = nx * px * ny * py;
-         logT << "Allocating " << atlas_bytes << " bytes for atlas buffer"
-              << std::endl;
-         atlasBuf.resize (atlas_bytes, 0);
+         if (face->num_fixed_sizes > 0)
+            loadFixed (face);
+         else
+            loadScaled (face);
       }
-
-      FT_UInt gindex;
-      FT_ULong charcode = FT_Get_First_Char (face, &gindex);
-      while (gindex != 0)
+      catch (const std::runtime_error&)
       {
-         if (isLoadableChar (charcode))
-         {
-            if (overlay)
-            {
-               const auto& it = atlasMap.find (charcode);
-               if (it != atlasMap.end ())
-               {
-                  loadFace (face, charcode, it->second);
-               }
-            }
-            else
-            {
-               loadFace (face, charcode);
-            }
-         }
-         charcode = FT_Get_Next_Char (face, charcode, &gindex);
+         FT_Done_Face (face);
+         face = nullptr;
+         throw;
       }
-
-      FT_Done_Face (face);
-      FT_Done_FreeType (ft);
    }
 
    void Font::loadFixed (const FT_Face& face)
@@ -302,103 +434,4 @@ namespace zutty
            << std::endl;
    }
 
-   void Font::loadFace (const FT_Face& face, FT_ULong c)
-   {
-      const uint8_t atlas_row = atlas_seq / nx;
-      const uint8_t atlas_col = atlas_seq - nx * atlas_row;
-      const AtlasPos apos = {atlas_col, atlas_row};
-
-      loadFace (face, c, apos);
-      atlasMap [c] = apos;
-      ++atlas_seq;
-   }
-
-   void Font::loadFace (const FT_Face& face, FT_ULong c, const AtlasPos& apos)
-   {
-      if (FT_Load_Char (face, c, FT_LOAD_RENDER))
-      {
-         throw std::runtime_error (
-            std::string ("FreeType: Failed to load glyph for char ") +
-            std::to_string (c));
-      }
-
-      // destination pixel offset
-      int dx = face->glyph->bitmap_left;
-      int dy = baseline > 0 ? baseline - face->glyph->bitmap_top : 0;
-
-      // source skip horiz and vert
-      const int sh = std::max (0, -dy);
-      const int sw = std::max (0, -dx);
-      dx += sw;
-      dy += sh;
-
-      // raw/rasterized bitmap dimensions
-      const auto& bmp = face->glyph->bitmap;
-      const int bh = std::min ({(int)bmp.rows - sh, py - dy});
-      const int bw = std::min ({(int)bmp.width - sw, px - dx});
-
-      const int atlas_row_offset = nx * px * py;
-      const int atlas_glyph_offset = apos.y * atlas_row_offset + apos.x * px;
-      const int atlas_write_offset = atlas_glyph_offset + nx * px * dy + dx;
-
-      if (overlay) // clear glyph area, as we are overwriting an existing glyph
-      {
-         for (int j = 0; j < py; ++j)
-         {
-            uint8_t* atl_dst_row =
-               atlasBuf.data () + atlas_glyph_offset + j * nx * px;
-            for (int k = 0; k < px; ++k)
-            {
-               *atl_dst_row++ = 0;
-            }
-         }
-      }
-
-      /* Load bitmap into atlas buffer area. Each row in the bitmap
-       * occupies bitmap.pitch bytes (with padding); this is the
-       * increment in the input bitmap array per row.
-       *
-       * Interpretation of bytes within the bitmap rows is subject to
-       * bitmap.pixel_mode, essentially either 8 bits (256-scale gray)
-       * per pixel, or 1 bit (mono) per pixel. Leftmost pixel is MSB.
-       *
-       */
-      const uint8_t* bmp_src_row;
-      uint8_t* atl_dst_row;
-      switch (bmp.pixel_mode)
-      {
-      case FT_PIXEL_MODE_MONO:
-         for (int j = sh; j < bh; ++j)
-         {
-            bmp_src_row = bmp.buffer + j * bmp.pitch;
-            atl_dst_row = atlasBuf.data () + atlas_write_offset + j * nx * px;
-            uint8_t byte = 0;
-            for (int k = 0; k < bw; ++k)
-            {
-               if (k % 8 == 0)
-                  byte = *bmp_src_row++;
-               if (k >= sw)
-                  *atl_dst_row++ = (byte & 0x80) ? 0xFF : 0;
-               byte <<= 1;
-            }
-         }
-         break;
-      case FT_PIXEL_MODE_GRAY:
-         for (int j = 0; j < bh; ++j)
-         {
-            bmp_src_row = bmp.buffer + (j + sh) * bmp.pitch + sw;
-            atl_dst_row = atlasBuf.data () + atlas_write_offset + j * nx * px;
-            for (int k = 0; k < bw; ++k)
-            {
-               *atl_dst_row++ = *bmp_src_row++;
-            }
-         }
-         break;
-      default:
-         throw std::runtime_error (
-            std::string ("Unhandled pixel_type=") +
-            std::to_string (bmp.pixel_mode));
-      }
-   }
-
 } // namespace zutty
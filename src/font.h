@@ -11,13 +11,16 @@
 
 #pragma once
 
+#include "fontcache.h"
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include <map>
 
 namespace zutty
 {
@@ -27,18 +30,17 @@ namespace zutty
       enum Overlay_ { Overlay };
       enum DoubleWidth_ { DoubleWidth };
 
-      /* Load a primary font, determining the atlas geometry and setting up
-       * a mapping from unicode code points to atlas grid positions.
+      /* Load a primary font, determining the glyph geometry and the set
+       * of code points that have glyphs.
        */
       explicit Font (const std::string& filename);
 
       /* Load an alternate font based on an already loaded primary font,
-       * conforming to the same atlas geometry (incl. position mapping)
-       * and starting with a copy of the atlas texture data.
+       * conforming to the same glyph geometry.
        *
        * It is an error if the alternate font has different geometry.
        * Any code point not having a glyph in the alternate font will
-       * have the glyph of the primary font (if any) in its atlas.
+       * have the glyph of the primary font (if any) in its atlas layer.
        * Any code point not having a glyph in the primary font will be
        * discarded.
        */
@@ -47,33 +49,40 @@ namespace zutty
       /* Load a double-width font based on an already loaded primary font.
        * A double-width font is less tightly coupled to the primary,
        * but its glyph size has to match (double width, equal height).
-       * The font will have its own independent atlas geometry.
+       * The font will have its own independent atlas.
        *
        * Only code points that are considered double-width by wcwidth ()
        * will be loaded.
        */
       Font (const std::string& filename, const Font& priFont, DoubleWidth_);
 
-      ~Font () = default;
+      ~Font ();
+
+      Font (const Font&) = delete;
+      Font& operator = (const Font&) = delete;
 
       uint16_t getPx () const { return px; };
       uint16_t getPy () const { return py; };
       uint16_t getBaseline () const { return baseline; };
-      uint16_t getNx () const { return nx; };
-      uint16_t getNy () const { return ny; };
       float getUlTop () const { return ulTop; };
       float getUlThick () const { return ulThick; };
 
-      const std::vector <uint8_t>& getAtlas () const { return atlasBuf; };
-      const uint8_t* getAtlasData () const { return atlasBuf.data (); };
+      // Number of code points with a glyph in the font (see hasGlyph ())
+      int getNumGlyphs () const { return numGlyphs; };
+
+      // Whether the font has a glyph to be loaded for code point c
+      bool hasGlyph (uint16_t c) const;
+
+      /* Rasterize the glyph of code point c into a glyph cell of px * py
+       * pixels at dst, with rows stride bytes apart. The cell is cleared
+       * first, so it is left blank if the glyph cannot be rendered.
+       */
+      void rasterize (uint16_t c, uint8_t* dst, int stride);
 
-      struct AtlasPos
-      {
-         uint8_t x = 0;
-         uint8_t y = 0;
-      };
-      using AtlasMap = std::map <uint16_t, AtlasPos>;
-      const AtlasMap& getAtlasMap () const { return atlasMap; };
+      /* Update the font cache (see fontcache.h) with what has been loaded
+       * and rasterized since the last update, if anything.
+       */
+      void saveCache ();
 
    private:
       std::string filename;
@@ -84,29 +93,34 @@ namespace zutty
       uint16_t baseline = 0; // number of pixels above baseline
       float ulTop = 0;   // underline top from glyph top in pixels
       float ulThick = 0; // underline thickness in pixels
-      uint16_t nx = 0; // number of glyphs in atlas texture per row
-      uint16_t ny = 0; // number of rows in atlas texture
-      std::vector <uint8_t> atlasBuf; // loaded atlas data
-      AtlasMap atlasMap; // unicode -> atlas position
-
-      /* Start with 1 so as to leave a blank glyph at (0,0).
-       * That blank will get referenced for any out-of-bounds text position
-       * lookup in the shader, and guarantees that no fractional glyphs will
-       * be shown at the right and bottom edges.
-       * Also, any glyph mapping lookup that results in (0,0) means that the
-       * character code does not exist in the atlas.
-       */
-      uint16_t atlas_seq = 1;
+      int numGlyphs = 0;
+
+      std::vector <uint8_t> coverage; // bitmap of code points with glyphs
+
+      // Glyphs are rasterized on demand, so the face is kept open (and
+      // only opened when needed if the font is loaded from the cache)
+      FT_Library ft = nullptr;
+      FT_Face face = nullptr;
+      bool faceFailed = false;
+
+      FontCache::Key cacheKey;
+      std::unique_ptr <FontCache> cache;
+      bool cacheDirty = false; // metrics and coverage not in the cache
+      std::vector <uint16_t> newCodes; // rasterized, not in the cache
+      std::vector <uint8_t> newGlyphs;
+      // Code point -> index in newCodes, so that glyphs evicted from the
+      // atlas and looked up again are neither rasterized nor stored twice
+      std::unordered_map <uint16_t, uint32_t> newIndex;
 
-      /* Load font from glyph bitmaps rasterized by FreeType.
-       * Store the bitmaps into an atlas bitmap stored in atlasBuf.
+      /* Determine the glyph geometry and the code points with glyphs,
+       * from the cache if possible; glyphs are rasterized later on, as
+       * needed by the GlyphAtlas (see atlas.h).
        */
-      bool isLoadableChar (FT_ULong c);
+      bool isLoadableChar (FT_ULong c) const;
       void load ();
+      void openFace ();
       void loadFixed (const FT_Face& face);
       void loadScaled (const FT_Face& face);
-      void loadFace (const FT_Face& face, FT_ULong c);
-      void loadFace (const FT_Face& face, FT_ULong c, const AtlasPos& apos);
    };
 
 } // namespace zutty
@@ -0,0 +1,551 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "fontcache.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <ftw.h>
+#include <sstream>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+   constexpr const char Magic [8] = {'Z', 'U', 'T', 'T', 'Y', 'F', 'C', '\0'};
+   constexpr const uint32_t Version = 1;
+   constexpr const uint32_t ByteOrder = 0x01020304;
+
+   size_t
+   align8 (size_t n)
+   {
+      return (n + 7) & ~(size_t)7;
+   }
+
+   // Create dir and its missing parents; return whether it exists
+   bool
+   makeDirs (const std::string& dir)
+   {
+      for (size_t pos = 1; pos != std::string::npos; )
+      {
+         pos = dir.find ('/', pos + 1);
+         const std::string sub = dir.substr (0, pos);
+         if (mkdir (sub.c_str (), 0700) < 0 && errno != EEXIST)
+         {
+            SYS_WARN ("Cannot create font cache directory ", sub);
+            return false;
+         }
+      }
+      return true;
+   }
+
+   std::string
+   cacheDir ()
+   {
+      const char* xdg = getenv ("XDG_CACHE_HOME");
+      if (xdg && xdg [0] == '/')
+         return std::string (xdg) + "/zutty";
+
+      const char* home = getenv ("HOME");
+      if (home && home [0] == '/')
+         return std::string (home) + "/.cache/zutty";
+
+      return "";
+   }
+
+   /* Write a file by writing a temporary file and renaming it, so that
+    * readers only ever see a complete file.
+    */
+   bool
+   writeFile (const std::string& path, const void* data, size_t len)
+   {
+      std::string tmpPath = path + ".XXXXXX";
+      const int fd = mkstemp (&tmpPath [0]);
+      if (fd < 0)
+      {
+         SYS_WARN ("Cannot create font cache file ", tmpPath);
+         return false;
+      }
+
+      size_t written = 0;
+      while (written < len)
+      {
+         ssize_t ret = write (fd, (const char*)data + written, len - written);
+         if (ret < 0 && errno == EINTR)
+            continue;
+         if (ret <= 0)
+            break;
+         written += ret;
+      }
+
+      if (written < len)
+      {
+         SYS_WARN ("Cannot write font cache file ", tmpPath);
+         close (fd);
+         unlink (tmpPath.c_str ());
+         return false;
+      }
+      close (fd);
+
+      if (rename (tmpPath.c_str (), path.c_str ()) < 0)
+      {
+         SYS_WARN ("Cannot rename font cache file to ", path);
+         unlink (tmpPath.c_str ());
+         return false;
+      }
+      return true;
+   }
+
+   // FNV-1a, to derive the cache file names from their keys
+   void
+   hash (uint64_t& h, const void* data, size_t len)
+   {
+      const uint8_t* p = (const uint8_t*)data;
+      for (size_t k = 0; k < len; ++k)
+      {
+         h ^= p [k];
+         h *= 0x100000001b3ULL;
+      }
+   }
+
+   std::string
+   hexHash (uint64_t h)
+   {
+      char hex [17];
+      snprintf (hex, sizeof (hex), "%016llx", (unsigned long long)h);
+      return hex;
+   }
+
+   constexpr const char* IndexHeader = "zutty-fontindex 1";
+
+   // Entries collected by the ongoing FontIndex walk
+   std::vector <zutty::FontIndex::Entry>* walkEntries = nullptr;
+   bool walkSavable = true;
+
+   bool
+   isDirFlag (int tflag)
+   {
+      return tflag == FTW_D || tflag == FTW_DP || tflag == FTW_DNR;
+   }
+
+   bool
+   hasFontExtension (const char* fname)
+   {
+      const char* ext = strrchr (fname, '.');
+      if (!ext)
+         return false;
+      for (const char* fontExt: {".ttc", ".ttf", ".otf", ".pcf", ".gz"})
+      {
+         if (strcasecmp (ext, fontExt) == 0)
+            return true;
+      }
+      return false;
+   }
+
+   int
+   indexEntry (const char* fpath, const struct stat* sb,
+               int tflag, struct FTW* ftwbuf)
+   {
+      const bool isDir = isDirFlag (tflag);
+      if (!isDir &&
+          ((tflag != FTW_F && tflag != FTW_SL) ||
+           !hasFontExtension (fpath + ftwbuf->base)))
+         return 0;
+
+      zutty::FontIndex::Entry entry;
+      entry.path = fpath;
+      entry.tflag = tflag;
+      entry.base = ftwbuf->base;
+      entry.level = ftwbuf->level;
+      if (isDir)
+      {
+         entry.mtimeSec = sb->st_mtim.tv_sec;
+         entry.mtimeNsec = sb->st_mtim.tv_nsec;
+      }
+      if (entry.path.find ('\n') != std::string::npos)
+         walkSavable = false;
+      walkEntries->push_back (std::move (entry));
+      return 0;
+   }
+
+} // namespace
+
+namespace zutty
+{
+   struct FontCache::Header
+   {
+      char magic [8];
+      uint32_t version;
+      uint32_t byteOrder;
+
+      // key
+      uint64_t dev;
+      uint64_t ino;
+      uint64_t size;
+      int64_t mtimeSec;
+      int64_t mtimeNsec;
+      uint32_t kind;
+      uint32_t fontsize;
+      uint32_t ftVersion;
+      uint16_t keyPx;
+      uint16_t keyPy;
+      uint16_t keyBaseline;
+      uint16_t pathLen; // followed by the font path, padded to 8 bytes
+
+      // data
+      uint16_t px;
+      uint16_t py;
+      uint16_t baseline;
+      float ulTop;
+      float ulThick;
+      uint32_t numGlyphs;
+      uint32_t numCached;
+
+      /* After the path:
+       * - coverage bitmap [Coverage_Size]
+       * - glyph index [65536] (uint16_t, 1-based; 0 = not cached)
+       * - glyph cells [numCached][px * py]
+       */
+   };
+
+   FontCache::FontCache (const std::string& fontFile_, const Key& key_)
+      : fontFile (fontFile_)
+      , key (key_)
+   {
+      struct stat sb;
+      if (stat (fontFile.c_str (), &sb) < 0)
+         return;
+
+      const std::string dir = cacheDir ();
+      if (dir.empty ())
+         return;
+
+      keyed = true;
+      dev = sb.st_dev;
+      ino = sb.st_ino;
+      size = sb.st_size;
+      mtimeSec = sb.st_mtim.tv_sec;
+      mtimeNsec = sb.st_mtim.tv_nsec;
+
+      uint64_t h = 0xcbf29ce484222325ULL;
+      hash (h, fontFile.data (), fontFile.size ());
+      for (uint32_t v: {key.kind, key.fontsize, key.ftVersion,
+                        (uint32_t)key.px, (uint32_t)key.py,
+                        (uint32_t)key.baseline})
+         hash (h, &v, sizeof (v));
+      const size_t slash = fontFile.rfind ('/');
+      path = dir + "/" +
+         (slash == std::string::npos ? fontFile : fontFile.substr (slash + 1))
+         + "-" + hexHash (h);
+
+      if (map ())
+      {
+         logT << "Font cache: using " << path << " with "
+              << header->numCached << " glyphs" << std::endl;
+      }
+   }
+
+   FontCache::~FontCache ()
+   {
+      unmap ();
+   }
+
+   const FontCache::Metrics&
+   FontCache::getMetrics () const
+   {
+      return metrics;
+   }
+
+   const uint8_t*
+   FontCache::getCoverage () const
+   {
+      return coverage;
+   }
+
+   const uint8_t*
+   FontCache::getGlyph (uint16_t c) const
+   {
+      if (!index || !index [c])
+         return nullptr;
+      return glyphs + (size_t)(index [c] - 1) * metrics.px * metrics.py;
+   }
+
+   void
+   FontCache::save (const Metrics& metrics_, const uint8_t* coverage_,
+                    const std::vector <uint16_t>& codes,
+                    const std::vector <uint8_t>& glyphs_)
+   {
+      if (!keyed || !makeDirs (path.substr (0, path.rfind ('/'))))
+         return;
+
+      const size_t cellSize = (size_t)metrics_.px * metrics_.py;
+      FontCache latest (fontFile, key);
+      // Only merge cells of the same size as the ones being saved
+      const bool ownFits = metrics.px == metrics_.px &&
+                           metrics.py == metrics_.py;
+      const bool latestFits = latest.metrics.px == metrics_.px &&
+                              latest.metrics.py == metrics_.py;
+      std::vector <const uint8_t*> cells (65536, nullptr);
+      for (int c = 0; c < 65536; ++c)
+      {
+         const uint8_t* cell = latestFits ? latest.getGlyph (c) : nullptr;
+         if (!cell && ownFits)
+            cell = getGlyph (c);
+         cells [c] = cell;
+      }
+      for (size_t k = 0; k < codes.size (); ++k)
+         cells [codes [k]] = glyphs_.data () + k * cellSize;
+
+      Header hdr;
+      memset (&hdr, 0, sizeof (hdr));
+      memcpy (hdr.magic, Magic, sizeof (Magic));
+      hdr.version = Version;
+      hdr.byteOrder = ByteOrder;
+      hdr.dev = dev;
+      hdr.ino = ino;
+      hdr.size = size;
+      hdr.mtimeSec = mtimeSec;
+      hdr.mtimeNsec = mtimeNsec;
+      hdr.kind = key.kind;
+      hdr.fontsize = key.fontsize;
+      hdr.ftVersion = key.ftVersion;
+      hdr.keyPx = key.px;
+      hdr.keyPy = key.py;
+      hdr.keyBaseline = key.baseline;
+      hdr.pathLen = fontFile.size ();
+      hdr.px = metrics_.px;
+      hdr.py = metrics_.py;
+      hdr.baseline = metrics_.baseline;
+      hdr.ulTop = metrics_.ulTop;
+      hdr.ulThick = metrics_.ulThick;
+      hdr.numGlyphs = metrics_.numGlyphs;
+
+      std::vector <uint16_t> idx (65536, 0);
+      std::vector <uint8_t> data;
+      for (int c = 0; c < 65536; ++c)
+      {
+         if (!cells [c] || hdr.numCached == UINT16_MAX)
+            continue;
+         idx [c] = ++hdr.numCached;
+         data.insert (data.end (), cells [c], cells [c] + cellSize);
+      }
+
+      std::vector <uint8_t> buf (align8 (sizeof (Header) + hdr.pathLen), 0);
+      memcpy (buf.data (), &hdr, sizeof (Header));
+      memcpy (buf.data () + sizeof (Header), fontFile.data (), hdr.pathLen);
+      buf.insert (buf.end (), coverage_, coverage_ + Coverage_Size);
+      buf.insert (buf.end (), (const uint8_t*)idx.data (),
+                  (const uint8_t*)(idx.data () + idx.size ()));
+      buf.insert (buf.end (), data.begin (), data.end ());
+
+      if (!writeFile (path, buf.data (), buf.size ()))
+         return;
+
+      logT << "Font cache: saved " << path << " with " << hdr.numCached
+           << " glyphs" << std::endl;
+   }
+
+   // private methods
+
+   bool
+   FontCache::map ()
+   {
+      const int fd = open (path.c_str (), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+         return false;
+
+      struct stat sb;
+      if (fstat (fd, &sb) < 0 || (size_t)sb.st_size < sizeof (Header))
+      {
+         close (fd);
+         return false;
+      }
+
+      mappingSize = sb.st_size;
+      mapping = mmap (nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      close (fd);
+      if (mapping == MAP_FAILED)
+      {
+         mapping = nullptr;
+         return false;
+      }
+
+      const Header* hdr = (const Header*)mapping;
+      const uint8_t* base = (const uint8_t*)mapping;
+      const size_t pathOffset = sizeof (Header);
+      const size_t coverageOffset = align8 (pathOffset + hdr->pathLen);
+      const size_t indexOffset = coverageOffset + Coverage_Size;
+      const size_t glyphsOffset = indexOffset + 65536 * sizeof (uint16_t);
+      if (memcmp (hdr->magic, Magic, sizeof (Magic)) != 0 ||
+          hdr->version != Version ||
+          hdr->byteOrder != ByteOrder ||
+          hdr->dev != dev || hdr->ino != ino || hdr->size != size ||
+          hdr->mtimeSec != mtimeSec || hdr->mtimeNsec != mtimeNsec ||
+          hdr->kind != key.kind || hdr->fontsize != key.fontsize ||
+          hdr->ftVersion != key.ftVersion ||
+          hdr->keyPx != key.px || hdr->keyPy != key.py ||
+          hdr->keyBaseline != key.baseline ||
+          hdr->pathLen != fontFile.size () ||
+          glyphsOffset > mappingSize ||
+          memcmp (base + pathOffset, fontFile.data (), hdr->pathLen) != 0 ||
+          glyphsOffset + (size_t)hdr->numCached * hdr->px * hdr->py
+             != mappingSize)
+      {
+         logT << "Font cache: ignoring stale " << path << std::endl;
+         unmap ();
+         return false;
+      }
+
+      // Reject out-of-range glyph indices, lest getGlyph read past the end
+      const uint16_t* idx = (const uint16_t*)(base + indexOffset);
+      for (int c = 0; c < 65536; ++c)
+         if (idx [c] > hdr->numCached)
+         {
+            logT << "Font cache: ignoring corrupt " << path << std::endl;
+            unmap ();
+            return false;
+         }
+
+      header = hdr;
+      metrics.px = hdr->px;
+      metrics.py = hdr->py;
+      metrics.baseline = hdr->baseline;
+      metrics.ulTop = hdr->ulTop;
+      metrics.ulThick = hdr->ulThick;
+      metrics.numGlyphs = hdr->numGlyphs;
+      coverage = base + coverageOffset;
+      index = idx;
+      glyphs = base + glyphsOffset;
+      return true;
+   }
+
+   void
+   FontCache::unmap ()
+   {
+      if (mapping)
+         munmap (mapping, mappingSize);
+      mapping = nullptr;
+      header = nullptr;
+      coverage = nullptr;
+      index = nullptr;
+      glyphs = nullptr;
+   }
+
+   FontIndex::FontIndex (const std::string& root_)
+      : root (root_)
+   {
+      const std::string dir = cacheDir ();
+      if (!dir.empty ())
+      {
+         uint64_t h = 0xcbf29ce484222325ULL;
+         hash (h, root.data (), root.size ());
+         path = dir + "/fontindex-" + hexHash (h);
+      }
+
+      if (!path.empty () && load ())
+      {
+         logT << "Font index: using " << path << " with " << entries.size ()
+              << " entries for " << root << std::endl;
+         valid = true;
+         return;
+      }
+
+      entries.clear ();
+      valid = walk ();
+      if (valid && !path.empty ())
+         save ();
+   }
+
+   // private methods
+
+   bool
+   FontIndex::load ()
+   {
+      std::ifstream in (path);
+      std::string line;
+      if (!std::getline (in, line) || line != IndexHeader ||
+          !std::getline (in, line) || line != root)
+         return false;
+
+      struct stat sb;
+      while (std::getline (in, line))
+      {
+         Entry entry;
+         long long mtimeSec = 0, mtimeNsec = 0;
+         int pathOffset = -1;
+         sscanf (line.c_str (), "%d %d %d %lld %lld%n",
+                 &entry.tflag, &entry.level, &entry.base,
+                 &mtimeSec, &mtimeNsec, &pathOffset);
+         if (pathOffset < 0 || (size_t)pathOffset >= line.size ())
+            return false;
+         entry.path = line.substr (pathOffset + 1);
+         entry.mtimeSec = mtimeSec;
+         entry.mtimeNsec = mtimeNsec;
+
+         if (isDirFlag (entry.tflag) &&
+             (stat (entry.path.c_str (), &sb) < 0 ||
+              sb.st_mtim.tv_sec != entry.mtimeSec ||
+              sb.st_mtim.tv_nsec != entry.mtimeNsec))
+         {
+            logT << "Font index: " << entry.path << " has changed"
+                 << std::endl;
+            return false;
+         }
+         entries.push_back (std::move (entry));
+      }
+      return true;
+   }
+
+   bool
+   FontIndex::walk ()
+   {
+      walkEntries = &entries;
+      walkSavable = true;
+      const int ret = nftw (root.c_str (), indexEntry, 32, FTW_DEPTH);
+      walkEntries = nullptr;
+      if (ret == -1)
+      {
+         SYS_WARN ("Cannot walk file tree at ", root);
+         return false;
+      }
+      logT << "Font index: walked " << root << ", " << entries.size ()
+           << " entries" << std::endl;
+      return true;
+   }
+
+   void
+   FontIndex::save ()
+   {
+      if (!walkSavable || root.find ('\n') != std::string::npos ||
+          !makeDirs (path.substr (0, path.rfind ('/'))))
+         return;
+
+      std::ostringstream out;
+      out << IndexHeader << "\n" << root << "\n";
+      for (const Entry& entry: entries)
+      {
+         out << entry.tflag << " " << entry.level << " " << entry.base << " "
+             << entry.mtimeSec << " " << entry.mtimeNsec << " "
+             << entry.path << "\n";
+      }
+
+      const std::string data = out.str ();
+      writeFile (path, data.data (), data.size ());
+   }
+
+} // namespace zutty
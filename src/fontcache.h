@@ -0,0 +1,162 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zutty
+{
+   /* Persistent cache of what a Font computes from its font file: glyph
+    * geometry, the set of code points with glyphs, and the glyphs
+    * rasterized so far. With a valid cache, a Font needs not open its
+    * face at all as long as the glyphs looked up are in the cache.
+    *
+    * Each font (as loaded with a given size, and in case of an overlay
+    * or double-width font, on a given primary) has its own cache file
+    * under $XDG_CACHE_HOME/zutty (or ~/.cache/zutty). The file is keyed
+    * by the font file's path, size, mtime, inode and the FreeType
+    * version; it is ignored (and eventually rewritten) if any of these
+    * do not match.
+    *
+    * The file is mapped into memory as is; the glyphs are stored as
+    * glyph cells of px * py bytes, ready to be copied into the atlas.
+    * Cache files are never modified in place: a new version is written
+    * to a temporary file and renamed over the old one, so any number of
+    * processes may read and write the cache at the same time.
+    */
+   class FontCache
+   {
+   public:
+      // What the cache entry depends on, besides the font file itself
+      struct Key
+      {
+         uint32_t kind = 0;     // primary, overlay or double-width
+         uint32_t fontsize = 0;
+         uint32_t ftVersion = 0;
+         uint16_t px = 0;       // geometry inherited from the primary
+         uint16_t py = 0;
+         uint16_t baseline = 0;
+      };
+
+      struct Metrics
+      {
+         uint16_t px = 0;
+         uint16_t py = 0;
+         uint16_t baseline = 0;
+         float ulTop = 0;
+         float ulThick = 0;
+         uint32_t numGlyphs = 0;
+      };
+
+      static constexpr int Coverage_Size = 65536 / 8;
+
+      // Map the cache file of the font, if there is a valid one
+      FontCache (const std::string& fontFile, const Key& key);
+
+      ~FontCache ();
+
+      FontCache (const FontCache&) = delete;
+      FontCache& operator = (const FontCache&) = delete;
+
+      // Whether a valid cache file was found
+      bool isValid () const { return header != nullptr; };
+
+      // Only to be called if isValid ()
+      const Metrics& getMetrics () const;
+
+      // Bitmap of code points with glyphs (bit c%8 of byte c/8)
+      const uint8_t* getCoverage () const;
+
+      // Cached glyph cell of code point c, or nullptr
+      const uint8_t* getGlyph (uint16_t c) const;
+
+      /* Write the cache file with the given data, and all cached glyphs
+       * (from this and the current cache file, which might have been
+       * updated by another process) plus the ones added.
+       */
+      void save (const Metrics& metrics, const uint8_t* coverage,
+                 const std::vector <uint16_t>& codes,
+                 const std::vector <uint8_t>& glyphs);
+
+   private:
+      struct Header;
+
+      std::string fontFile;
+      Key key;
+      std::string path; // of the cache file
+      bool keyed = false; // the font file could be stat'ed
+      uint64_t dev = 0;
+      uint64_t ino = 0;
+      uint64_t size = 0;
+      int64_t mtimeSec = 0;
+      int64_t mtimeNsec = 0;
+
+      void* mapping = nullptr;
+      size_t mappingSize = 0;
+      const Header* header = nullptr;
+      Metrics metrics;
+      const uint8_t* coverage = nullptr;
+      const uint16_t* index = nullptr;
+      const uint8_t* glyphs = nullptr;
+
+      bool map ();
+      void unmap ();
+   };
+
+   /* Index of a font directory tree, sparing Fontpack a walk of the whole
+    * tree (and a stat () of each file in it) on every startup.
+    *
+    * The index lists the directories in the tree and the files that
+    * might be fonts (by their extension), in the order and with the
+    * attributes nftw () reports them, so that a search over the index
+    * yields the same results as one walking the tree. It is kept in the
+    * cache directory (see FontCache) and rebuilt by walking the tree if
+    * the mtime of any directory in it has changed, i.e. if any file was
+    * added, removed or renamed since. Checking this still takes a stat ()
+    * per directory, but fonts typically far outnumber directories.
+    */
+   class FontIndex
+   {
+   public:
+      // An entry as reported by nftw ()
+      struct Entry
+      {
+         std::string path;
+         int tflag = 0;
+         int base = 0;  // offset of the file name in path
+         int level = 0; // depth relative to the root
+         int64_t mtimeSec = 0; // of directories
+         int64_t mtimeNsec = 0;
+      };
+
+      // Load the index of the tree under root, or build it if need be
+      explicit FontIndex (const std::string& root);
+
+      // Whether the tree could be walked
+      bool isValid () const { return valid; };
+
+      const std::vector <Entry>& getEntries () const { return entries; };
+
+   private:
+      std::string root;
+      std::string path; // of the index file
+      std::vector <Entry> entries;
+      bool valid = false;
+
+      bool load ();
+      bool walk ();
+      void save ();
+   };
+
+} // namespace zutty
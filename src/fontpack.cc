@@ -10,9 +10,14 @@
  */
 
 #include "fontpack.h"
+#include "fontcache.h"
 #include "log.h"
 
+#include <chrono>
+#include <cmath>
 #include <ftw.h>
+#include <future>
+#include <map>
 //#include <stdio.h> // DEBUG
 #include <string.h>
 #include <strings.h>
@@ -174,24 +179,20 @@ namespace
       return 0;
    }
 
-} // namespace
-
-namespace zutty
-{
-   Fontpack::Fontpack (const std::string& fontpath,
-                       const std::string& fontname,
-                       const std::string& dwfontname)
-   {
-      logT << "Fontpack: fontpath=" << fontpath
-           << "; fontname=" << fontname
-           << "; dwfontname=" << dwfontname
-           << std::endl;
-
-      // Look for & initialize the regular font (with variants)
+   using zutty::Font;
+   using zutty::FontIndex;
 
-      sstate.fontname = fontname.data ();
-      sstate.fontnamelen = fontname.size ();
+   using FontIndexes = std::map <std::string, std::unique_ptr <FontIndex>>;
 
+   /* Look for candidates of the font named by sstate under the directories
+    * of fontpath (separated by colons), until a regular variant is found.
+    * Each directory tree is searched via its index, built (or loaded)
+    * only once into indexes.
+    */
+   void
+   searchFontpath (const std::string& fontpath, const char* what,
+                   FontIndexes& indexes)
+   {
       size_t pos = 0;
       size_t nextpos = 0;
       do
@@ -202,75 +203,154 @@ namespace zutty
                     : nextpos - pos;
 
          std::string fontpath1 = fontpath.substr (pos, len);
-         logT << "Looking for candidates under " << fontpath1 << std::endl;
+         logT << "Looking for " << what << " under " << fontpath1 << std::endl;
          pos = nextpos + 1;
 
-         int flags = FTW_DEPTH;
-         if (nftw (fontpath1.c_str (), fontFileFilter, 32, flags) == -1)
+         auto& index = indexes [fontpath1];
+         if (!index)
+            index = std::make_unique <FontIndex> (fontpath1);
+
+         struct FTW ftwbuf;
+         for (const auto& entry: index->getEntries ())
          {
-            SYS_WARN ("Cannot walk file tree at ", fontpath1);
+            ftwbuf.base = entry.base;
+            ftwbuf.level = entry.level;
+            if (fontFileFilter (entry.path.c_str (), nullptr,
+                                entry.tflag, &ftwbuf))
+               break;
          }
 
       } while (!sstate.regular.size () && nextpos != std::string::npos);
+   }
 
-      if (! sstate.regular.size ())
-      {
-         logE << "No Regular variant of the requested font '" << fontname
-              << "' could be identified." << std::endl;
-         throw std::runtime_error (std::string ("No suitable files for '") +
-                                   fontname + "' found!");
-      }
+   // Milliseconds elapsed since t0, rounded to 0.1 for logging
+   double
+   msSince (std::chrono::steady_clock::time_point t0)
+   {
+      using namespace std::chrono;
+      const auto us = duration_cast <microseconds> (steady_clock::now () - t0);
+      return std::round (us.count () / 100.0) / 10.0;
+   }
 
-      fontRegular = std::make_unique <Font> (sstate.regular);
-      px = fontRegular->getPx ();
-      py = fontRegular->getPy ();
+   // Outcome of loading an optional font, possibly on another thread
+   struct LoadResult
+   {
+      std::unique_ptr <Font> font = nullptr;
+      std::string error;
+      double ms = 0;
+   };
 
+   template <typename Kind>
+   LoadResult
+   loadFont (const std::string& filename, const Font* priFont, Kind kind)
+   {
+      LoadResult ret;
+      const auto t0 = std::chrono::steady_clock::now ();
       try
       {
-         if (sstate.bold.size ())
-            fontBold = std::make_unique <Font> (
-               sstate.bold, * fontRegular.get (), Font::Overlay);
+         ret.font = std::make_unique <Font> (filename, *priFont, kind);
       }
       catch (const std::runtime_error& e)
       {
-         fontBold = nullptr;
-         logW << "Failed to load bold variant: " << e.what () << std::endl;
+         ret.error = e.what ();
       }
+      ret.ms = msSince (t0);
+      return ret;
+   }
 
-      try
+   // Start loading an overlay font on its own thread, if there is one
+   std::future <LoadResult>
+   loadOverlayAsync (const std::string& filename, const Font* priFont)
+   {
+      if (filename.empty ())
+         return std::future <LoadResult> ();
+      return std::async (std::launch::async, loadFont <Font::Overlay_>,
+                         filename, priFont, Font::Overlay);
+   }
+
+   // Log the outcome of loading a font and take it
+   std::unique_ptr <Font>
+   takeFont (LoadResult&& result, const char* what)
+   {
+      if (result.font)
       {
-         if (sstate.italic.size ())
-            fontItalic = std::make_unique <Font> (
-               sstate.italic, * fontRegular.get (), Font::Overlay);
+         logI << "Loaded " << what << " in " << result.ms
+              << " ms" << std::endl;
       }
-      catch (const std::runtime_error& e)
+      else
       {
-         fontItalic = nullptr;
-         logW << "Failed to load italic variant: " << e.what () << std::endl;
+         logW << "Failed to load " << what << ": " << result.error
+              << std::endl;
       }
+      return std::move (result.font);
+   }
 
-      try
+   std::unique_ptr <Font>
+   takeFont (std::future <LoadResult>& future, const char* what)
+   {
+      if (!future.valid ())
+         return nullptr;
+      return takeFont (future.get (), what);
+   }
+
+} // namespace
+
+namespace zutty
+{
+   Fontpack::Fontpack (const std::string& fontpath,
+                       const std::string& fontname,
+                       const std::string& dwfontname,
+                       bool synthStyles_)
+      : synthStyles (synthStyles_)
+   {
+      logT << "Fontpack: fontpath=" << fontpath
+           << "; fontname=" << fontname
+           << "; dwfontname=" << dwfontname
+           << std::endl;
+
+      // Look for & initialize the regular font (with variants)
+
+      sstate.fontname = fontname.data ();
+      sstate.fontnamelen = fontname.size ();
+
+      FontIndexes indexes;
+      searchFontpath (fontpath, "candidates", indexes);
+
+      if (! sstate.regular.size ())
       {
-         if (sstate.boldItalic.size ())
-            fontBoldItalic = std::make_unique <Font> (
-               sstate.boldItalic, * fontRegular.get (), Font::Overlay);
+         logE << "No Regular variant of the requested font '" << fontname
+              << "' could be identified." << std::endl;
+         throw std::runtime_error (std::string ("No suitable files for '") +
+                                   fontname + "' found!");
       }
-      catch (const std::runtime_error& e)
+
       {
-         fontBoldItalic = nullptr;
-         logW << "Failed to load boldItalic variant: " << e.what () << std::endl;
+         const auto t0 = std::chrono::steady_clock::now ();
+         fontRegular = std::make_unique <Font> (sstate.regular);
+         logI << "Loaded regular variant in " << msSince (t0) << " ms"
+              << std::endl;
       }
+      px = fontRegular->getPx ();
+      py = fontRegular->getPy ();
 
-      // Initialize the underline metrics
+      if (synthStyles)
+      {
+         logI << "Synthesizing bold and italic variants from regular"
+              << std::endl;
+         sstate.bold = "";
+         sstate.italic = "";
+         sstate.boldItalic = "";
+      }
 
-      ulMetrics [0] = getRegular().getUlTop ();
-      ulMetrics [1] = getRegular().getUlThick ();
-      ulMetrics [2] = getBold().getUlTop ();
-      ulMetrics [3] = getBold().getUlThick ();
-      ulMetrics [4] = getItalic().getUlTop ();
-      ulMetrics [5] = getItalic().getUlThick ();
-      ulMetrics [6] = getBoldItalic().getUlTop ();
-      ulMetrics [7] = getBoldItalic().getUlThick ();
+      /* The other fonts only depend on the geometry of the regular one,
+       * so they are loaded concurrently, each with its own FreeType
+       * library instance. The double-width font is located meanwhile,
+       * and loaded on this thread.
+       */
+      auto futureBold = loadOverlayAsync (sstate.bold, fontRegular.get ());
+      auto futureItalic = loadOverlayAsync (sstate.italic, fontRegular.get ());
+      auto futureBoldItalic = loadOverlayAsync (sstate.boldItalic,
+                                                fontRegular.get ());
 
       // Look for & initialize the double-width font
 
@@ -284,43 +364,78 @@ namespace zutty
       sstate.fontname = dwfontname.data ();
       sstate.fontnamelen = dwfontname.size ();
 
-      pos = 0;
-      nextpos = 0;
-      do
+      searchFontpath (fontpath, "double-width candidates", indexes);
+
+      if (sstate.regular.size ())
+         fontDoubleWidth = takeFont (
+            loadFont (sstate.regular, fontRegular.get (), Font::DoubleWidth),
+            "double-width font");
+      else if (dwfontname != "")
       {
-         nextpos = fontpath.find (':', pos);
-         size_t len = (nextpos == std::string::npos)
-                    ? std::string::npos
-                    : nextpos - pos;
+         logW << "Failed to locate requested double-width font: "
+              << dwfontname << std::endl;
+      }
 
-         std::string fontpath1 = fontpath.substr (pos, len);
-         logT << "Looking for double-width candidates under " << fontpath1
-              << std::endl;
-         pos = nextpos + 1;
+      fontBold = takeFont (futureBold, "bold variant");
+      fontItalic = takeFont (futureItalic, "italic variant");
+      fontBoldItalic = takeFont (futureBoldItalic, "boldItalic variant");
 
-         int flags = FTW_DEPTH;
-         if (nftw (fontpath1.c_str (), fontFileFilter, 32, flags) == -1)
-         {
-            SYS_WARN ("Cannot walk file tree at ", fontpath1);
-         }
+      // Initialize the underline metrics
 
-      } while (!sstate.regular.size () && nextpos != std::string::npos);
+      ulMetrics [0] = getRegular().getUlTop ();
+      ulMetrics [1] = getRegular().getUlThick ();
+      ulMetrics [2] = getBold().getUlTop ();
+      ulMetrics [3] = getBold().getUlThick ();
+      ulMetrics [4] = getItalic().getUlTop ();
+      ulMetrics [5] = getItalic().getUlThick ();
+      ulMetrics [6] = getBoldItalic().getUlTop ();
+      ulMetrics [7] = getBoldItalic().getUlThick ();
 
-      try
-      {
-         if (sstate.regular.size ())
-            fontDoubleWidth = std::make_unique <Font> (
-               sstate.regular, * fontRegular.get (), Font::DoubleWidth);
-         else if (dwfontname != "")
-         {
-            logW << "Failed to locate requested double-width font: "
-                 << dwfontname << std::endl;
-         }
-      }
-      catch (const std::runtime_error& e)
+      // Set up the glyph atlases, with the fallbacks of the getters above
+      // (only the regular font is needed if the other styles are synthesized)
+
+      auto pick = [] (const std::unique_ptr <Font>& font, Font* dflt)
+                  {
+                     return font ? font.get () : dflt;
+                  };
+      Font* regular = fontRegular.get ();
+      Font* bold = pick (fontBold, regular);
+      Font* italic = pick (fontItalic, regular);
+      Font* boldItalic = pick (fontBoldItalic,
+                               pick (fontItalic, pick (fontBold, regular)));
+      if (synthStyles)
+         atlas = std::make_unique <GlyphAtlas> (std::vector <Font*> {regular});
+      else
+         atlas = std::make_unique <GlyphAtlas> (
+            std::vector <Font*> {regular, bold, italic, boldItalic});
+      logI << "Glyph atlas: " << atlas->getNumLayers () << " layer(s) of "
+           << atlas->getStride () << "x" << atlas->getNy () * py
+           << " pixels, " << atlas->getNumLayers () * atlas->getStride () *
+                             atlas->getNy () * py / 1024
+           << " KiB" << std::endl;
+
+      if (fontDoubleWidth)
+         atlasDoubleWidth = std::make_unique <GlyphAtlas> (
+            std::vector <Font*> {fontDoubleWidth.get ()});
+
+      saveCaches ();
+   }
+
+   Fontpack::~Fontpack ()
+   {
+      saveCaches ();
+   }
+
+   // private methods
+
+   void
+   Fontpack::saveCaches ()
+   {
+      for (auto* font: {&fontRegular, &fontBold, &fontItalic,
+                        &fontBoldItalic, &fontDoubleWidth})
       {
-         fontDoubleWidth = nullptr;
-         logW << "Failed to load double-width font: " << e.what () << std::endl;
+         if (*font)
+            (*font)->saveCache ();
       }
    }
 
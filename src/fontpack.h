@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include "atlas.h"
 #include "font.h"
 
 #include <cstdint>
@@ -28,13 +29,20 @@ namespace zutty
        * all but the first are optional. If not even a regular variant of
        * the requested font can be loaded, an exception is thrown.
        * Additionally, a double-width font with the given name is optionally
-       * located and initialized.
+       * located and initialized. The glyph atlases are set up with only a
+       * few glyphs preloaded; the rest are loaded as they are looked up.
+       * The font caches are updated once the atlases are set up, and on
+       * destruction.
+       * With synthStyles, the Bold and Italic variants are not loaded at
+       * all: the renderer synthesizes them from the Regular glyphs (see
+       * synthesizesStyles ()).
        */
       Fontpack (const std::string& fontpath,
                 const std::string& fontname,
-                const std::string& dwfontname);
+                const std::string& dwfontname,
+                bool synthStyles = false);
 
-      ~Fontpack () = default;
+      ~Fontpack ();
 
       uint16_t getPx () const { return px; };
       uint16_t getPy () const { return py; };
@@ -84,24 +92,38 @@ namespace zutty
          return * fontDoubleWidth.get ();
       };
 
-      void releaseFonts ()
-      {
-         fontRegular = nullptr;
-         fontBold = nullptr;
-         fontItalic = nullptr;
-         fontBoldItalic = nullptr;
-         fontDoubleWidth = nullptr;
-      }
+      /* Whether the renderer is to synthesize Bold (by widening strokes
+       * one pixel to the right), Italic (by slanting glyphs around the
+       * row getItalicPivot ()) and BoldItalic from the Regular glyphs.
+       */
+      bool synthesizesStyles () const { return synthStyles; };
+      uint16_t getItalicPivot () const { return (py - 1) / 2; };
+
+      /* Glyph atlas of the four styles (in the order of the getters
+       * above), or only of Regular if the other styles are synthesized.
+       */
+      GlyphAtlas& getAtlas () { return * atlas.get (); };
+
+      GlyphAtlas& getAtlasDoubleWidth () {
+         if (! hasDoubleWidth ())
+            throw std::runtime_error ("No DoubleWidth font present!");
+         return * atlasDoubleWidth.get ();
+      };
 
    private:
       uint16_t px = 0; // glyph width in pixels
       uint16_t py = 0; // glyph height in pixels
       float ulMetrics [8];
+      bool synthStyles = false;
       std::unique_ptr <Font> fontRegular = nullptr;
       std::unique_ptr <Font> fontBold = nullptr;
       std::unique_ptr <Font> fontItalic = nullptr;
       std::unique_ptr <Font> fontBoldItalic = nullptr;
       std::unique_ptr <Font> fontDoubleWidth = nullptr;
+      std::unique_ptr <GlyphAtlas> atlas = nullptr;
+      std::unique_ptr <GlyphAtlas> atlasDoubleWidth = nullptr;
+
+      void saveCaches ();
    };
 
 } // namespace zutty
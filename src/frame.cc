@@ -12,6 +12,8 @@
 #include "frame.h"
 #include "log.h"
 
+#include <algorithm>
+
 namespace zutty
 {
    Frame::Frame () {}
@@ -32,6 +34,7 @@ namespace zutty
       , viewOffset (0)
       , margins (false)
       , cells (CharVdev::make_cells (nCols, nRows + saveLines))
+      , cellsCapacity (nCols * (nRows + saveLines))
    {
       marginTop_ = marginTop;
       marginBottom_ = nRows;
@@ -39,11 +42,51 @@ namespace zutty
       highMemUsageReport ();
    }
 
+   /* Reinitialize the frame to the given size, with blank cells and no
+    * history. This is equivalent to constructing a new frame, but reuses
+    * the cell storage if it is large enough (e.g. for the alternate screen).
+    */
+   void
+   Frame::reset (uint16_t winPx_, uint16_t winPy_,
+                 uint16_t nCols_, uint16_t nRows_,
+                 uint16_t& marginTop_, uint16_t& marginBottom_)
+   {
+      freezeSelectedText ();
+
+      const uint32_t count = nCols_ * (nRows_ + saveLines);
+      if (!cells || cellsCapacity < count)
+      {
+         uint32_t capacity;
+         auto newCells = allocCells (count, capacity);
+         replaceCells (std::move (newCells), capacity);
+      }
+      fillCellSpan (cells.get (), CharVdev::Cell (), count);
+
+      winPx = winPx_;
+      winPy = winPy_;
+      nCols = nCols_;
+      nRows = nRows_;
+      scrollHead = 0;
+      marginTop = marginTop_ = 0;
+      marginBottom = nRows + saveLines;
+      marginBottom_ = nRows;
+      historyRows = 0;
+      viewOffset = 0;
+      margins = false;
+      cursor = CharVdev::Cursor ();
+      selection.clear ();
+      snapTo = SelectSnapTo::Char;
+      marks = nullptr;
+      damage.totalCells = count;
+      expose ();
+   }
+
    void
    Frame::dropScrollbackHistory ()
    {
       viewOffset = 0;
       historyRows = 0;
+      pruneMarks ();
       expose ();
    }
 
@@ -68,10 +111,19 @@ namespace zutty
       expose ();
    }
 
+   /* Resizing rewraps the logical lines (runs of rows joined by the wrap
+    * mark on their last cell) of both the screen and the history to the
+    * new width, so that their content is preserved. This is done in two
+    * passes over the old cell storage: first collect the logical lines and
+    * lay them out on the new width, then copy their content as spans into
+    * the new storage. The cost of this is bounded by the scrollback buffer
+    * size, so resizing stays fast even with a large history.
+    */
    void
    Frame::resize (uint16_t winPx_, uint16_t winPy_,
                   uint16_t nCols_, uint16_t nRows_,
-                  uint16_t& marginTop_, uint16_t& marginBottom_)
+                  uint16_t& marginTop_, uint16_t& marginBottom_,
+                  uint16_t& posX_, uint16_t& posY_)
    {
       if (winPx == winPx_ && winPy == winPy_)
          return;
@@ -82,25 +134,112 @@ namespace zutty
       if (nCols == nCols_ && nRows == nRows_)
          return;
 
-      auto newCells = CharVdev::make_cells (nCols_, nRows_ + saveLines);
-      CharVdev::Cell* dst = newCells.get ();
+      freezeSelectedText ();
 
-      const int rowLen = std::min (nCols, nCols_);
-      const int nCopyRows = std::min (nRows, nRows_);
-      CharVdev::Cell* p = dst;
-      for (int pY = 0; pY < nCopyRows; ++pY)
+      const int curY = std::min ((int)posY_, nRows - 1);
+      const int curX = std::min ((int)posX_, nCols - 1);
+
+      // Blank rows below the cursor at the bottom of the screen are dropped
+      int lastRow = nRows - 1;
+      while (lastRow > curY && isBlankRow (lastRow))
+         --lastRow;
+
+      // Pass 1: collect logical lines and their layout on the new width
+      std::vector <LogicalLine> lines;
+      lines.reserve (historyRows + lastRow + 1);
+      uint32_t nNewRows = 0;  // total number of rows after rewrapping
+      uint32_t topRow = 0;    // new row of the old top row of the screen
+      Point curPos;           // new (absolute) position of the cursor
+      for (int pY = -historyRows; pY <= lastRow; ++pY)
       {
-         memcpy (p, getPhysRowPtr (pY), rowLen * cellSize);
-         p += nCols_;
+         LogicalLine line = getLogicalLine (pY, lastRow);
+         if (line.firstRow <= 0 && 0 <= pY)
+         {
+            uint32_t offset = -line.firstRow * nCols;
+            topRow = nNewRows + locateInLine (line, offset, nCols_).y;
+         }
+         if (line.firstRow <= curY && curY <= pY)
+         {
+            uint32_t offset = (curY - line.firstRow) * nCols + curX;
+            line.length = std::max (line.length, offset + 1);
+            curPos = locateInLine (line, offset, nCols_);
+            curPos.y += nNewRows;
+         }
+         for (uint32_t start = 0; ; ++line.nRows)
+         {
+            start = getLineBreak (line, start, nCols_);
+            if (start >= line.length)
+            {
+               ++line.nRows;
+               break;
+            }
+         }
+         nNewRows += line.nRows;
+         lines.push_back (line);
       }
-      p = dst + (nRows_ + saveLines - historyRows) * nCols_;
-      for (int pY = -historyRows; pY < 0; ++pY)
+
+      // Keep the top of the screen where it was, but pull in history rows
+      // when growing, and scroll as needed to keep the cursor on screen.
+      uint32_t screenTop = topRow - std::min ((int)topRow,
+                                              std::max (0, nRows_ - nRows));
+      if ((uint32_t)curPos.y >= screenTop + nRows_)
+         screenTop = curPos.y - nRows_ + 1;
+      const uint32_t newHistoryRows = std::min (screenTop, (uint32_t)saveLines);
+      const uint32_t firstRow = screenTop - newHistoryRows;
+      const uint32_t endRow = screenTop + nRows_;
+
+      // Pass 2: copy the content into its new place
+      const int totalRows = nRows_ + saveLines;
+      uint32_t capacity;
+      auto newCells = allocCells (nCols_ * totalRows, capacity);
+      fillCellSpan (newCells.get (), CharVdev::Cell (), nCols_ * totalRows);
+      uint32_t newRow = 0;
+      for (const LogicalLine& line: lines)
       {
-         memcpy (p, getPhysRowPtr (pY), rowLen * cellSize);
-         p += nCols_;
+         if (newRow >= endRow)
+            break;
+         if (newRow + line.nRows <= firstRow)
+         {
+            newRow += line.nRows;
+            continue;
+         }
+
+         uint32_t start = 0;
+         for (uint32_t r = 0; r < line.nRows; ++r, ++newRow)
+         {
+            const uint32_t end = r + 1 < line.nRows
+                               ? getLineBreak (line, start, nCols_)
+                               : line.length;
+            if (newRow < firstRow || newRow >= endRow)
+            {
+               start = end;
+               continue;
+            }
+
+            int pY = newRow - screenTop;
+            if (pY < 0)
+               pY += totalRows;
+            CharVdev::Cell* dst = newCells.get () + pY * nCols_;
+            CharVdev::Cell* p = dst;
+            while (start < end)
+            {
+               const int srcY = line.firstRow + start / nCols;
+               const uint16_t srcX = start % nCols;
+               const uint16_t count = std::min (end - start,
+                                                (uint32_t)(nCols - srcX));
+               memcpy (p, getPhysRowPtr (srcY) + srcX, count * cellSize);
+               p += count;
+               start += count;
+               if (srcX + count == nCols)
+                  p [-1].wrap = 0;
+            }
+            if (r + 1 < line.nRows)
+               dst [nCols_ - 1].wrap = 1;
+         }
       }
 
-      cells = std::move (newCells);
+      remapMarks (lines, nCols_, nRows_, screenTop, newHistoryRows);
+      replaceCells (std::move (newCells), capacity);
       nCols = nCols_;
       nRows = nRows_;
       scrollHead = 0;
@@ -108,8 +247,13 @@ namespace zutty
       marginBottom_ = nRows;
       marginBottom = nRows + saveLines;
       margins = false;
+      historyRows = newHistoryRows;
       viewOffset = 0;
+      posX_ = curPos.x;
+      posY_ = curPos.y - screenTop;
+      selection.clear ();
       damage.totalCells = nCols * (nRows + saveLines);
+      expose ();
       highMemUsageReport ();
    }
 
@@ -122,17 +266,103 @@ namespace zutty
          memcpy (p, getViewRowPtr (pY), nCols * cellSize);
          p += nCols;
       }
+      copyOverlay (dst);
    }
 
    void
-   Frame::deltaCopyCells (CharVdev::Cell * const dst)
+   Frame::deltaCopyCells (CharVdev::Cell * const dst,
+                          std::vector <uint32_t>* dirtyCells)
    {
-      CharVdev::Cell* p = dst;
+      uint32_t dstIdx = 0;
       for (int pY = -viewOffset; pY < nRows - viewOffset; ++pY)
       {
-         damageDeltaCopy (p, nCols * getPhysicalRow (pY), nCols);
-         p += nCols;
+         damageDeltaCopy (dst + dstIdx, dstIdx, nCols * getPhysicalRow (pY),
+                          nCols, dirtyCells);
+         dstIdx += nCols;
+      }
+      copyOverlay (dst, dirtyCells);
+   }
+
+   // Copy the text of count rows starting at pY, one code unit per cell
+   void
+   Frame::copyText (int pY, int count, uint16_t* dst,
+                    uint16_t dwidthCont) const
+   {
+      for (int y = pY; y < pY + count; ++y)
+      {
+         const auto* cp = getPhysRowPtr (y);
+         for (uint16_t x = 0; x < nCols; ++x)
+            *dst++ = cp [x].dwidth_cont ? dwidthCont : cp [x].uc_pt;
+      }
+   }
+
+   void
+   Frame::setOverlay (Overlay&& overlay_)
+   {
+      damageOverlay (); // cells under the current overlay must be restored
+      if (overlay_.empty ())
+         overlay = nullptr;
+      else
+         overlay = std::make_shared <const Overlay> (std::move (overlay_));
+      damageOverlay ();
+   }
+
+   /* Record a mark on row pY. Marks arrive in the order of the output, so
+    * a mark on an earlier row than those recorded before (e.g. after the
+    * screen has been cleared) supersedes them. A new prompt supersedes all
+    * kinds of marks from its row onwards.
+    */
+   void
+   Frame::addMark (uint16_t pY, Mark mark)
+   {
+      if (!marks)
+         marks = std::make_shared <MarkIndex> ();
+
+      const int64_t row = scrollPos + pY;
+      for (uint8_t m = 0; m < static_cast <uint8_t> (Mark::COUNT); ++m)
+      {
+         if (mark != Mark::PromptStart && m != static_cast <uint8_t> (mark))
+            continue;
+         auto& rows = marks->rows [m];
+         while (!rows.empty () && rows.back () >= row)
+            rows.pop_back ();
+      }
+      marks->rows [static_cast <uint8_t> (mark)].push_back (row);
+      pruneMarks ();
+   }
+
+   /* Find the nearest mark of the given type before (or after) row pY by
+    * binary search. On success, return its row in markY (negative if it is
+    * in the history).
+    */
+   bool
+   Frame::findMark (Mark mark, int pY, bool before, int& markY) const
+   {
+      if (!marks)
+         return false;
+
+      const auto& rows = marks->rows [static_cast <uint8_t> (mark)];
+      int64_t found;
+      if (before)
+      {
+         auto it = std::lower_bound (rows.begin (), rows.end (),
+                                     scrollPos + pY);
+         if (it == rows.begin ())
+            return false;
+         found = *--it;
       }
+      else
+      {
+         // Skip marks that have left the history, but are not pruned yet
+         pY = std::max (pY, -historyRows - 1);
+         auto it = std::upper_bound (rows.begin (), rows.end (),
+                                     scrollPos + pY);
+         if (it == rows.end ())
+            return false;
+         found = *it;
+      }
+      markY = found - scrollPos;
+      return markY >= -historyRows && markY < nRows;
    }
 
    Rect
@@ -175,78 +405,166 @@ namespace zutty
       return ret;
    }
 
-   bool
-   Frame::getSelectedUtf8 (std::string& utf8_selection) const
+   // Number of bytes needed to encode a span of cells as UTF-8
+   static inline size_t
+   utf8Size (const CharVdev::Cell* cp, const CharVdev::Cell* const end)
    {
-      const Rect sel = getSnappedSelection ();
+      size_t size = 0;
+      for (; cp < end; ++cp)
+      {
+         const uint16_t uc = cp->uc_pt;
+         size += cp->dwidth_cont ? 0 : 1 + (uc >= 0x80) + (uc >= 0x800);
+      }
+      return size;
+   }
 
-      if (sel.empty ())
-         return false;
+   // Encode a span of cells as UTF-8 into out, return the end of the output
+   static inline char*
+   utf8Encode (const CharVdev::Cell* cp, const CharVdev::Cell* const end,
+               char* out)
+   {
+      auto sinkFn = [&] (char ch) { *out++ = ch; };
+      while (cp < end)
+      {
+         // Fast path for runs of ASCII, which is what most text is made of
+         while (cp < end && cp->uc_pt < 0x80 && !cp->dwidth_cont)
+            *out++ = (cp++)->uc_pt;
+
+         if (cp == end)
+            break;
+         if (!cp->dwidth_cont)
+            Utf8Encoder::pushUnicode (cp->uc_pt, sinkFn);
+         ++cp;
+      }
+      return out;
+   }
+
+   std::shared_ptr <Frame::SelectedText>
+   Frame::getSelectedText ()
+   {
+      if (getSnappedSelection ().empty ())
+         return nullptr;
+
+      freezeSelectedText ();
+      std::shared_ptr <SelectedText> ret (new SelectedText (*this));
+      selectedText = ret;
+      return ret;
+   }
+
+   void
+   Frame::SelectedText::take (std::string& utf8_selection)
+   {
+      freeze ();
+      utf8_selection.swap (text);
+      text.clear ();
+   }
+
+   void
+   Frame::SelectedText::freeze ()
+   {
+      if (frozen)
+         return;
 
-      using utf16str = std::vector <uint16_t>;
-      std::vector <utf16str> lines;
+      frame.getSelectedUtf8 (text);
+      frame.freeCells (); // release the cell storage
+      frozen = true;
+   }
+
+   /* Call fn (cp, end, newlines) for each span of selected cells with
+    * text content, where newlines is the number of line breaks preceding
+    * the span. Rows joined by the wrap mark are kept on one line; other
+    * rows have their trailing whitespace trimmed. Line breaks after the
+    * last span (i.e., trailing empty lines) are discarded.
+    */
+   template <typename Fn>
+   void
+   Frame::forEachSelectedSpan (const Rect& sel, Fn&& fn) const
+   {
+      uint32_t newlines = 0;
+      bool first = true;
       bool wrap = false;
 
-      // save lines from the selected range of the frame cell buffer
-      auto addLine =
+      auto addRow =
          [&] (int y, uint16_t x1, uint16_t x2)
          {
-            utf16str line;
-            bool wrapBack = wrap;
+            if (!first && !wrap)
+               ++newlines;
+            first = false;
+
+            const CharVdev::Cell* const row = getViewRowPtr (y);
+            const CharVdev::Cell* cp = row + x1;
+            const CharVdev::Cell* end = row + std::max (x1, x2);
             wrap = false;
-            const auto* cp = getViewRowPtr (y);
-            for (uint16_t x = x1; x < x2; ++x)
-            {
-               const auto& cell = cp [x];
-               if (!cell.dwidth_cont)
-                  line.push_back (cell.uc_pt);
-               if (cell.wrap)
+            for (const CharVdev::Cell* p = cp; p < end; ++p)
+               if (p->wrap)
                {
+                  end = p + 1;
                   wrap = true;
                   break;
                }
-            }
 
-            while (!wrap && line.size () && line.back () == ' ')
-               line.pop_back (); // discard trailing whitespace
+            if (!wrap)
+               while (end > cp && end [-1].uc_pt == ' ' &&
+                      !end [-1].dwidth_cont)
+                  --end; // discard trailing whitespace
+            while (cp < end && cp->dwidth_cont)
+               ++cp;
 
-            if (wrapBack && lines.size ())
-               lines.back ().insert (lines.back ().end (),
-                                     line.begin (), line.end ());
-            else
-               lines.push_back (line);
+            if (cp < end)
+            {
+               fn (cp, end, newlines);
+               newlines = 0;
+            }
          };
 
       if (sel.tl.y == sel.br.y)
       {
-         addLine (sel.tl.y, sel.tl.x, sel.br.x);
+         addRow (sel.tl.y, sel.tl.x, sel.br.x);
       }
       else if (sel.rectangular)
       {
          for (int y = sel.tl.y; y <= sel.br.y; ++y)
-            addLine (y, sel.tl.x, sel.br.x);
+            addRow (y, sel.tl.x, sel.br.x);
       }
       else
       {
-         addLine (sel.tl.y, sel.tl.x, nCols);
+         addRow (sel.tl.y, sel.tl.x, nCols);
          for (int y = sel.tl.y + 1; y < sel.br.y; ++y)
-            addLine (y, 0, nCols);
-         addLine (sel.br.y, 0, sel.br.x);
+            addRow (y, 0, nCols);
+         addRow (sel.br.y, 0, sel.br.x);
       }
+   }
 
-      // convert to UTF-8
-      std::vector <char> utf8_out;
-      auto sinkFn = [&] (char ch) { utf8_out.push_back (ch); };
-      for (const auto& u16s: lines)
-      {
-         for (uint16_t cp: u16s)
-            Utf8Encoder::pushUnicode (cp, sinkFn);
-         utf8_out.push_back ('\n');
-      }
-      while (utf8_out.size () && utf8_out.back () == '\n')
-         utf8_out.pop_back (); // discard trailing empty lines
+   /* Extract the selected text as UTF-8. The selected cells are walked
+    * twice: once to find the exact size of the output, then to encode it
+    * straight into the (pre-sized) result, so no intermediate copies of
+    * the text are made even for selections spanning the whole history.
+    */
+   bool
+   Frame::getSelectedUtf8 (std::string& utf8_selection) const
+   {
+      const Rect sel = getSnappedSelection ();
 
-      utf8_selection = std::string (utf8_out.data (), utf8_out.size ());
+      if (sel.empty ())
+         return false;
+
+      size_t size = 0;
+      forEachSelectedSpan (sel,
+         [&] (const CharVdev::Cell* cp, const CharVdev::Cell* end,
+              uint32_t newlines)
+         {
+            size += newlines + utf8Size (cp, end);
+         });
+
+      utf8_selection.resize (size);
+      char* out = &utf8_selection [0];
+      forEachSelectedSpan (sel,
+         [&] (const CharVdev::Cell* cp, const CharVdev::Cell* end,
+              uint32_t newlines)
+         {
+            out = std::fill_n (out, newlines, '\n');
+            out = utf8Encode (cp, end, out);
+         });
 
    #if DEBUG
       if (utf8_selection.size () <= 80)
@@ -263,8 +581,18 @@ namespace zutty
 
    // private functions
 
+   void
+   Frame::freezeSelectedText ()
+   {
+      if (auto st = selectedText.lock ())
+         st->freeze ();
+      selectedText.reset ();
+   }
+
    inline void
-   Frame::damageDeltaCopy (CharVdev::Cell* dst, uint32_t start, uint32_t count)
+   Frame::damageDeltaCopy (CharVdev::Cell* dst, uint32_t dstIdx,
+                           uint32_t start, uint32_t count,
+                           std::vector <uint32_t>* dirtyCells)
    {
       uint32_t end = start + count;
 
@@ -274,6 +602,7 @@ namespace zutty
       if (start < damage.start)
       {
          dst += (damage.start - start);
+         dstIdx += (damage.start - start);
          start = damage.start;
       }
 
@@ -284,12 +613,188 @@ namespace zutty
 
       CharVdev::Cell* const src = cells.get ();
 
+      // Fast path for (typically whole rows of) unchanged cells, e.g. when
+      // the whole frame is exposed on switching back from the alt screen
+      if (memcmp (dst, src + start, (end - start) * cellSize) == 0)
+         return;
+
       for (size_t i = 0, j = start; j < end; ++i, ++j)
       {
          if (dst [i] != src [j])
          {
             dst [i] = src [j];
             dst [i].dirty = 1;
+            if (dirtyCells)
+               dirtyCells->push_back (dstIdx + i);
+         }
+      }
+   }
+
+   // Does the cell look like erased space with default attributes?
+   static inline bool
+   isBlankCell (const CharVdev::Cell& c)
+   {
+      return c.uc_pt == ' ' && !c.dwidth_cont && !c.inverse &&
+             !c.underline && c.bg == opts.bg;
+   }
+
+   bool
+   Frame::isBlankRow (int pY) const
+   {
+      const auto* cp = getPhysRowPtr (pY);
+      for (uint16_t x = 0; x < nCols; ++x)
+         if (!isBlankCell (cp [x]))
+            return false;
+      return true;
+   }
+
+   /* Gather the logical line starting at row pY, consisting of that row and
+    * all rows following it via wrap marks, but not beyond lastRow. On return,
+    * pY is the last row of the line. Trailing blanks are not counted in the
+    * line length, so they do not end up as spurious wrapped rows.
+    */
+   Frame::LogicalLine
+   Frame::getLogicalLine (int& pY, int lastRow) const
+   {
+      LogicalLine line {pY, 0, 0};
+      while (pY < lastRow && getPhysRowPtr (pY) [nCols - 1].wrap)
+         ++pY;
+
+      const auto* cp = getPhysRowPtr (pY);
+      uint16_t x = nCols;
+      while (x > 0 && isBlankCell (cp [x - 1]))
+         --x;
+
+      line.length = (pY - line.firstRow) * nCols + x;
+      return line;
+   }
+
+   inline const CharVdev::Cell&
+   Frame::getLineCell (const LogicalLine& line, uint32_t offset) const
+   {
+      return getPhysRowPtr (line.firstRow + offset / nCols) [offset % nCols];
+   }
+
+   /* Return the offset where the row starting at offset start ends when the
+    * line is wrapped to nCols_ columns. Double-width characters are not
+    * split; their first half is moved to the next row instead.
+    */
+   inline uint32_t
+   Frame::getLineBreak (const LogicalLine& line, uint32_t start,
+                        uint16_t nCols_) const
+   {
+      uint32_t end = start + nCols_;
+      if (end >= line.length)
+         return line.length;
+      if (end - start > 1 && getLineCell (line, end).dwidth_cont)
+         --end;
+      return end;
+   }
+
+   // Get the position of offset within line when wrapped to nCols_ columns
+   Point
+   Frame::locateInLine (const LogicalLine& line, uint32_t offset,
+                        uint16_t nCols_) const
+   {
+      uint32_t start = 0;
+      int row = 0;
+      for (;;)
+      {
+         uint32_t end = getLineBreak (line, start, nCols_);
+         if (offset < end || end >= line.length)
+            return Point (std::min (offset - start, nCols_ - 1u), row);
+         start = end;
+         ++row;
+      }
+   }
+
+   /* Move the marks along with their rows when these are rewrapped by
+    * resize () to the layout given by lines, where screenTop is the new row
+    * of the top of the screen. Marks on rows that do not make it into the
+    * resized frame are dropped.
+    */
+   void
+   Frame::remapMarks (const std::vector <LogicalLine>& lines,
+                      uint16_t nCols_, uint16_t nRows_,
+                      int screenTop, int newHistoryRows)
+   {
+      if (!marks)
+         return;
+
+      for (auto& rows: marks->rows)
+      {
+         std::deque <int64_t> remapped;
+         size_t k = 0;
+         int newRow = 0; // new row of the first row of lines [k]
+         for (int64_t row: rows)
+         {
+            const int pY = row - scrollPos;
+            if (pY < lines.front ().firstRow)
+               continue;
+            while (k + 1 < lines.size () && lines [k + 1].firstRow <= pY)
+               newRow += lines [k++].nRows;
+
+            const LogicalLine& line = lines [k];
+            const uint32_t offset = (pY - line.firstRow) * nCols;
+            const int newY = newRow - screenTop +
+                             locateInLine (line, offset, nCols_).y;
+            if (newY < -newHistoryRows || newY >= nRows_)
+               continue;
+            if (remapped.empty () || remapped.back () < scrollPos + newY)
+               remapped.push_back (scrollPos + newY);
+         }
+         rows.swap (remapped);
+      }
+   }
+
+   // Forget the marks on rows that have left the history
+   void
+   Frame::pruneMarks ()
+   {
+      if (!marks)
+         return;
+
+      const int64_t firstRow = scrollPos - historyRows;
+      for (auto& rows: marks->rows)
+         while (!rows.empty () && rows.front () < firstRow)
+            rows.pop_front ();
+   }
+
+   void
+   Frame::damageOverlay ()
+   {
+      if (!overlay)
+         return;
+
+      for (const auto& oc: *overlay)
+      {
+         if (oc.pY >= nRows || oc.pX >= nCols)
+            continue;
+         uint32_t idx = nCols * getPhysicalRow (oc.pY - viewOffset) + oc.pX;
+         damage.add (idx, idx + 1);
+      }
+   }
+
+   // Apply the overlay to dst (holding the cells of the view)
+   void
+   Frame::copyOverlay (CharVdev::Cell* dst,
+                       std::vector <uint32_t>* dirtyCells) const
+   {
+      if (!overlay)
+         return;
+
+      for (const auto& oc: *overlay)
+      {
+         if (oc.pY >= nRows || oc.pX >= nCols)
+            continue;
+         const uint32_t idx = nCols * oc.pY + oc.pX;
+         auto& c = dst [idx];
+         if (c != oc.cell)
+         {
+            c = oc.cell;
+            c.dirty = 1;
+            if (dirtyCells)
+               dirtyCells->push_back (idx);
          }
       }
    }
@@ -303,6 +808,7 @@ namespace zutty
          memcpy (p, getPhysRowPtr (pY), nCols * cellSize);
          p += nCols;
       }
+      fillCellSpan (p, CharVdev::Cell (), (saveLines - historyRows) * nCols);
       p = dst + (nRows + saveLines - historyRows) * nCols;
       for (int pY = -historyRows; pY < 0; ++pY)
       {
@@ -317,19 +823,55 @@ namespace zutty
       if (scrollHead == marginTop)
          return;
 
-      auto newCells = CharVdev::make_cells (nCols, nRows + saveLines);
+      uint32_t capacity;
+      auto newCells = allocCells (nCols * (nRows + saveLines), capacity);
       copyAllCells (newCells.get ());
-      cells = std::move (newCells);
+      replaceCells (std::move (newCells), capacity);
+      releaseSpareCells (); // only worth keeping while resizing
       scrollHead = marginTop;
    }
 
+   /* Get storage for at least count cells. The spare storage left behind
+    * by the previous reallocation is reused if it is large enough and no
+    * longer referenced by the renderer. New storage is never allocated
+    * smaller than the current one, so that shrinking and growing back does
+    * not need to allocate at all once both buffers have reached that size.
+    */
+   CharVdev::Cell::Ptr
+   Frame::allocCells (uint32_t count, uint32_t& capacity)
+   {
+      if (spare.cells && spare.capacity >= count &&
+          spare.cells.use_count () == 1)
+      {
+         capacity = spare.capacity;
+         spare.capacity = 0;
+         return std::move (spare.cells);
+      }
+
+      capacity = std::max (count, cellsCapacity);
+      return CharVdev::make_cells (capacity);
+   }
+
+   void
+   Frame::replaceCells (CharVdev::Cell::Ptr&& newCells, uint32_t capacity)
+   {
+      spare.cells = std::move (cells);
+      spare.capacity = cellsCapacity;
+      cells = std::move (newCells);
+      cellsCapacity = capacity;
+   }
+
    void
    Frame::highMemUsageReport ()
    {
-      auto allocKB = damage.totalCells * cellSize / 1024;
+      auto allocKB =
+         uint64_t (std::max (damage.totalCells, cellsCapacity) +
+                   spare.capacity) * cellSize / 1024;
       if (allocKB > 8192)
       {
-         logI << "Allocated " << allocKB << " KiB for cell storage; consider "
+         logI << "Allocated " << allocKB << " KiB for cell storage"
+              << (spare.capacity ? " (including spare for resizing)" : "")
+              << "; consider "
               << "decreasing saveLines (current value: " << saveLines
               << ") to reduce memory usage!"
               << std::endl;
@@ -14,6 +14,9 @@
 #include "charvdev.h"
 #include "utf8.h"
 
+#include <deque>
+#include <vector>
+
 namespace zutty
 {
    class Frame
@@ -28,7 +31,12 @@ namespace zutty
 
       void resize (uint16_t winPx_, uint16_t winPy_,
                    uint16_t nCols_, uint16_t nRows_,
-                   uint16_t& marginTop_, uint16_t& marginBottom_);
+                   uint16_t& marginTop_, uint16_t& marginBottom_,
+                   uint16_t& posX_, uint16_t& posY_);
+
+      void reset (uint16_t winPx_, uint16_t winPy_,
+                  uint16_t nCols_, uint16_t nRows_,
+                  uint16_t& marginTop_, uint16_t& marginBottom_);
 
       void dropScrollbackHistory ();
       void setMargins (uint16_t marginTop_, uint16_t marginBottom_);
@@ -36,10 +44,17 @@ namespace zutty
 
       void fillCells (uint16_t ch, const CharVdev::Cell& attrs);
       void fullCopyCells (CharVdev::Cell * const dest);
-      void deltaCopyCells (CharVdev::Cell * const dest);
+      // Copy changed cells only, marking them dirty; their indices are
+      // appended to dirtyCells, if given
+      void deltaCopyCells (CharVdev::Cell * const dest,
+                           std::vector <uint32_t>* dirtyCells = nullptr);
 
       operator bool () const { return cells != nullptr; }
-      void freeCells () { cells = nullptr; }
+      void freeCells () { cells = nullptr; releaseSpareCells (); }
+
+      // Free the storage kept for reuse by the next reallocation, once a
+      // burst of resizes is over
+      void releaseSpareCells () { spare.cells = nullptr; spare.capacity = 0; }
 
       const CharVdev::Cell & getCell (uint16_t pY, uint16_t pX) const;
       CharVdev::Cell & getCell (uint16_t pY, uint16_t pX);
@@ -57,11 +72,40 @@ namespace zutty
       void pageUp (uint16_t count);
       void pageDown (uint16_t count);
       void pageToBottom ();
+      void pageToRow (int pY);
       uint16_t getHistoryRows () const { return historyRows; };
+      uint16_t getViewOffset () const { return viewOffset; };
+      int64_t getScrollPos () const { return scrollPos; };
+
+      void copyText (int pY, int count, uint16_t* dst,
+                     uint16_t dwidthCont) const;
+
+      // Cells drawn over the view (e.g. a prompt), not part of its content
+      struct OverlayCell
+      {
+         uint16_t pY; // position in view coordinates
+         uint16_t pX;
+         CharVdev::Cell cell;
+      };
+      using Overlay = std::vector <OverlayCell>;
+      void setOverlay (Overlay&& overlay_);
+
+      // Shell integration marks (OSC 133) recorded on rows. They stay
+      // attached to their rows as these scroll into the history.
+      enum class Mark: uint8_t
+      {
+         PromptStart = 0, CommandStart, OutputStart, CommandEnd, COUNT
+      };
+      void addMark (uint16_t pY, Mark mark);
+      bool findMark (Mark mark, int pY, bool before, int& markY) const;
 
       void expose () { damage.expose (); };
       void resetDamage () { damage.reset (); };
 
+      // Rows the whole view has scrolled up by since the damage was last
+      // reset, or -1 if the view has been exposed or scrolled otherwise
+      int getScrollCount () const { return damage.scrollCount; };
+
       const CharVdev::Cursor& getCursor () const { return cursor; };
       void setCursorPos (uint16_t pY, uint16_t pX);
       void setCursorStyle (CharVdev::Cursor::Style cs);
@@ -73,14 +117,19 @@ namespace zutty
       };
       void setSelectSnapTo (SelectSnapTo snapTo_) { snapTo = snapTo_; };
       void cycleSelectSnapTo () { snapTo = cycleSelectSnapTo (snapTo); };
-      Rect& getSelection () { return selection; };
+      Rect& getSelection () { freezeSelectedText (); return selection; };
       const Rect& getSelection () const { return selection; };
       Rect getSnappedSelection () const;
       bool getSelectedUtf8 (std::string& utf8_selection) const;
 
+      // Selected text to be extracted when (and if) it is needed
+      class SelectedText;
+      std::shared_ptr <SelectedText> getSelectedText ();
+
       constexpr const static size_t cellSize = sizeof (CharVdev::Cell);
 
       uint64_t seqNo = 0; // update counter (used by Renderer)
+      bool fullRedraw = false; // to be rendered anew (used by Renderer)
 
       uint16_t winPx = 0;
       uint16_t winPy = 0;
@@ -89,23 +138,52 @@ namespace zutty
       uint16_t saveLines = 0;
 
    private:
-      uint16_t scrollHead;   // row offset of scrolling area's logical top row
-      uint16_t marginTop;    // current margin top (number of rows above)
-      uint16_t marginBottom; // current margin bottom (number of rows above + 1)
-      uint16_t historyRows;  // number of history (off-screen) rows with data
-      uint16_t viewOffset;   // how many rows above top row does the view start?
+      uint16_t scrollHead = 0;   // row offset of scrolling area's logical top row
+      uint16_t marginTop = 0;    // current margin top (number of rows above)
+      uint16_t marginBottom = 0; // current margin bottom (number of rows above + 1)
+      uint16_t historyRows = 0;  // number of history (off-screen) rows with data
+      uint16_t viewOffset = 0;   // how many rows above top row does the view start?
       bool margins = false;  // are there (non-default) top/bottom margins set?
+      int64_t scrollPos = 0; // net number of rows scrolled up since creation
+
+      std::shared_ptr <const Overlay> overlay = nullptr;
+
+      // Mark positions by type, as absolute rows (scrollPos + frame row),
+      // in ascending order. Shared (but not used) by copies of the frame.
+      struct MarkIndex
+      {
+         std::deque <int64_t> rows [static_cast <uint8_t> (Mark::COUNT)];
+      };
+      std::shared_ptr <MarkIndex> marks = nullptr;
 
       CharVdev::Cell::Ptr cells = nullptr;
+      uint32_t cellsCapacity = 0; // number of cells allocated
+
+      // Cell storage kept around after resizing for reuse by the next
+      // reallocation, until releaseSpareCells (). It is never shared with
+      // copies of the frame.
+      struct SpareCells
+      {
+         CharVdev::Cell::Ptr cells = nullptr;
+         uint32_t capacity = 0;
+
+         SpareCells () = default;
+         SpareCells (const SpareCells&) {}
+         SpareCells& operator = (const SpareCells&) { return *this; }
+      };
+      SpareCells spare;
+
       CharVdev::Cursor cursor;
       Rect selection;
       SelectSnapTo snapTo = SelectSnapTo::Char;
+      std::weak_ptr <SelectedText> selectedText; // pending extraction
 
       struct Damage
       {
          uint32_t start = 0;
          uint32_t end = 0;
          uint32_t totalCells = 0;
+         int scrollCount = 0;
 
          void reset ();
          void expose ();
@@ -120,12 +198,44 @@ namespace zutty
       const CharVdev::Cell & operator [] (uint32_t idx) const;
       CharVdev::Cell & operator [] (uint32_t idx);
 
+      CharVdev::Cell::Ptr allocCells (uint32_t count, uint32_t& capacity);
+      void replaceCells (CharVdev::Cell::Ptr&& newCells, uint32_t capacity);
+
       void eraseRange (uint32_t start, uint32_t end,
                        const CharVdev::Cell& attrs);
+      static void fillCellSpan (CharVdev::Cell* dst,
+                                const CharVdev::Cell& tmpl, uint32_t count);
       void copyCells (uint32_t dstIx, uint32_t srcIx, uint32_t count);
       void moveCells (uint32_t dstIx, uint32_t srcIx, uint32_t count);
 
-      void damageDeltaCopy (CharVdev::Cell* dst, uint32_t start, uint32_t count);
+      struct LogicalLine
+      {
+         int firstRow;    // first row of the line (negative if in history)
+         uint32_t length; // number of cells to keep when rewrapping
+         uint32_t nRows;  // number of rows after rewrapping
+      };
+      bool isBlankRow (int pY) const;
+      LogicalLine getLogicalLine (int& pY, int lastRow) const;
+      const CharVdev::Cell& getLineCell (const LogicalLine& line,
+                                         uint32_t offset) const;
+      uint32_t getLineBreak (const LogicalLine& line, uint32_t start,
+                             uint16_t nCols_) const;
+      Point locateInLine (const LogicalLine& line, uint32_t offset,
+                          uint16_t nCols_) const;
+      void remapMarks (const std::vector <LogicalLine>& lines,
+                       uint16_t nCols_, uint16_t nRows_,
+                       int screenTop, int newHistoryRows);
+      void pruneMarks ();
+
+      template <typename Fn>
+      void forEachSelectedSpan (const Rect& sel, Fn&& fn) const;
+
+      void damageDeltaCopy (CharVdev::Cell* dst, uint32_t dstIdx,
+                            uint32_t start, uint32_t count,
+                            std::vector <uint32_t>* dirtyCells);
+      void damageOverlay ();
+      void copyOverlay (CharVdev::Cell* dst,
+                        std::vector <uint32_t>* dirtyCells = nullptr) const;
       void copyAllCells (CharVdev::Cell * const dest);
       void unwrapCellStorage ();
 
@@ -136,12 +246,35 @@ namespace zutty
             static_cast <uint8_t> (SelectSnapTo::COUNT));
       }
 
+      void freezeSelectedText ();
       void vscrollSelection (int vertOffset);
       void invalidateSelection (const Rect&& damage);
 
       void highMemUsageReport ();
    };
 
+   /* The text of a selection as it was when the selection was made. This
+    * holds a copy of the frame, sharing its cell storage, to extract the
+    * text from on demand. The frame freezes it (extracts the text right
+    * away) before changing any of the selected cells, or the selection.
+    */
+   class Frame::SelectedText
+   {
+   public:
+      // Move the text into utf8_selection (only the first call gets it)
+      void take (std::string& utf8_selection);
+
+   private:
+      friend class Frame;
+      explicit SelectedText (const Frame& frame_): frame (frame_) {}
+
+      void freeze ();
+
+      Frame frame;
+      std::string text;
+      bool frozen = false;
+   };
+
 } // namespace zutty
 
 #include "frame.icc"
@@ -0,0 +1,286 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "headless.h"
+#include "log.h"
+#include "options.h"
+#include "softvdev.h"
+#include "vterm.h"
+
+#include <cerrno>
+#include <fstream>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+namespace
+{
+   using namespace zutty;
+
+   volatile sig_atomic_t snapshotRequested = 0;
+
+   void
+   sigusr1Handler (int sig)
+   {
+      snapshotRequested = 1;
+   }
+
+   bool
+   hasSuffix (const std::string& str, const char* suffix)
+   {
+      const size_t len = strlen (suffix);
+      return str.size () >= len &&
+             str.compare (str.size () - len, len, suffix) == 0;
+   }
+
+   // Keep checkpoint names from reaching outside the snapshot directory
+   std::string
+   sanitizeName (const std::string& name)
+   {
+      std::string ret;
+      for (char ch: name)
+      {
+         if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+             (ch >= '0' && ch <= '9') || ch == '-' || ch == '_' ||
+             (ch == '.' && !ret.empty ()))
+            ret.push_back (ch);
+         else
+            ret.push_back ('_');
+      }
+      return ret.empty () ? "_" : ret;
+   }
+
+   void
+   putU32 (std::string& out, uint32_t val)
+   {
+      out.push_back (val >> 24);
+      out.push_back (val >> 16);
+      out.push_back (val >> 8);
+      out.push_back (val);
+   }
+
+   void
+   putPngChunk (std::string& out, const char* type, const std::string& data)
+   {
+      putU32 (out, data.size ());
+      const size_t begin = out.size ();
+      out.append (type, 4);
+      out.append (data);
+      putU32 (out, crc32 (0, (const Bytef*)out.data () + begin,
+                          out.size () - begin));
+   }
+
+   // Encode the frame buffer (0x00RRGGBB pixels) as an RGB PNG image
+   bool
+   encodePng (std::string& out, const uint32_t* pixels, int stride,
+              int width, int height)
+   {
+      std::string raw;
+      raw.reserve ((3 * width + 1) * height);
+      for (int y = 0; y < height; ++y)
+      {
+         raw.push_back (0); // filter type: None
+         const uint32_t* row = pixels + y * stride;
+         for (int x = 0; x < width; ++x)
+         {
+            raw.push_back (row [x] >> 16);
+            raw.push_back (row [x] >> 8);
+            raw.push_back (row [x]);
+         }
+      }
+
+      uLongf zLen = compressBound (raw.size ());
+      std::string zData (zLen, '\0');
+      if (compress2 ((Bytef*)&zData [0], &zLen,
+                     (const Bytef*)raw.data (), raw.size (),
+                     Z_BEST_SPEED) != Z_OK)
+         return false;
+      zData.resize (zLen);
+
+      std::string ihdr;
+      putU32 (ihdr, width);
+      putU32 (ihdr, height);
+      ihdr.append ({8,   // bit depth
+                    2,   // color type: RGB
+                    0,   // compression method
+                    0,   // filter method
+                    0}); // interlace method: none
+
+      out = "\x89PNG\r\n\x1a\n";
+      putPngChunk (out, "IHDR", ihdr);
+      putPngChunk (out, "IDAT", zData);
+      putPngChunk (out, "IEND", "");
+      return true;
+   }
+
+   void
+   encodeRgba (std::string& out, const uint32_t* pixels, int stride,
+               int width, int height)
+   {
+      out.clear ();
+      out.reserve (4 * width * height);
+      for (int y = 0; y < height; ++y)
+      {
+         const uint32_t* row = pixels + y * stride;
+         for (int x = 0; x < width; ++x)
+         {
+            out.push_back (row [x] >> 16);
+            out.push_back (row [x] >> 8);
+            out.push_back (row [x]);
+            out.push_back (0xff);
+         }
+      }
+   }
+
+   class Snapshotter
+   {
+   public:
+      Snapshotter (Fontpack* fontpk, const char* dir_)
+         : vdev (fontpk)
+         , dir (dir_)
+      {
+         if (mkdir (dir.c_str (), 0777) < 0 && errno != EEXIST)
+         {
+            logE << "Cannot create snapshot directory " << dir << ": "
+                 << strerror (errno) << std::endl;
+         }
+      }
+
+      void
+      update (const Frame& frame_)
+      {
+         frame = frame_;
+      }
+
+      void
+      snapshot (const std::string& name)
+      {
+         if (!frame.nCols || !frame.nRows)
+            return;
+
+         vdev.resize (frame.winPx, frame.winPy);
+         {
+            CharVdev::Mapping m = vdev.getMapping ();
+            frame.fullCopyCells (m.cells);
+         }
+         vdev.setDeltaFrame (false);
+         vdev.setCursor (frame.getCursor ());
+         vdev.setSelection (frame.getSnappedSelection ());
+         vdev.draw ();
+
+         std::string fileName = sanitizeName (name);
+         std::string data;
+         if (hasSuffix (fileName, ".rgba"))
+            encodeRgba (data, vdev.getPixels (), vdev.getStride (),
+                        frame.winPx, frame.winPy);
+         else
+         {
+            if (!hasSuffix (fileName, ".png"))
+               fileName += ".png";
+            if (!encodePng (data, vdev.getPixels (), vdev.getStride (),
+                            frame.winPx, frame.winPy))
+            {
+               logE << "Cannot encode snapshot " << fileName << std::endl;
+               return;
+            }
+         }
+
+         const std::string path = dir + "/" + fileName;
+         std::ofstream out (path, std::ios::binary | std::ios::trunc);
+         out.write (data.data (), data.size ());
+         if (out.good ())
+         {
+            logI << "Snapshot saved: " << path << std::endl;
+         }
+         else
+         {
+            logE << "Cannot write snapshot " << path << std::endl;
+         }
+      }
+
+   private:
+      SoftCharVdev vdev;
+      Frame frame;
+      std::string dir;
+   };
+
+} // namespace
+
+namespace zutty
+{
+   int
+   runHeadless (Fontpack* fontpk, int ptyFd)
+   {
+      {
+         struct sigaction sa {};
+         sa.sa_handler = sigusr1Handler;
+         sa.sa_flags = 0;
+         if (sigaction (SIGUSR1, &sa, nullptr) < 0)
+            SYS_ERROR ("can't install SIGUSR1 handler: sigaction()");
+      }
+
+      const int winWidth = 2 * opts.border + opts.nCols * fontpk->getPx ();
+      const int winHeight = 2 * opts.border + opts.nRows * fontpk->getPy ();
+
+      Snapshotter snap (fontpk, opts.headless);
+
+      Vterm vt (fontpk->getPx (), fontpk->getPy (), winWidth, winHeight, ptyFd);
+      vt.setRefreshHandler ([&] (const Frame& f) { snap.update (f); });
+      // Take the checkpoint right away, before parsing any further: the
+      // redraw hands the current frame over to snap synchronously
+      vt.setOscHandler ([&] (int cmd, const std::string& arg)
+                        {
+                           if (cmd == Checkpoint_Osc)
+                           {
+                              vt.redraw ();
+                              snap.snapshot (arg);
+                           }
+                        });
+      // Draw the cursor as in a focused window (which is what tests expect)
+      vt.setHasFocus (true);
+      vt.resize (winWidth, winHeight);
+
+      struct pollfd pollset [] = {
+         {ptyFd, POLLIN, 0},
+         {-1, POLLOUT, 0}, // pty output queue
+      };
+
+      int nSnapshots = 0;
+      bool done = false;
+      while (!done)
+      {
+         pollset [1].fd = vt.hasPtyOutput () ? ptyFd : -1;
+         if (poll (pollset, 2, vt.flushPtyResize ()) < 0)
+            done = errno != EINTR;
+         else
+         {
+            if (pollset [1].revents & (POLLOUT | POLLERR | POLLHUP))
+               done = vt.flushPtyOutput ();
+
+            if (!done && pollset [0].revents & (POLLIN | POLLHUP))
+               done = vt.readPty ();
+         }
+
+         if (snapshotRequested)
+         {
+            snapshotRequested = 0;
+            snap.snapshot ("snapshot_" + std::to_string (++nSnapshots));
+         }
+      }
+
+      snap.snapshot ("exit");
+      return 0;
+   }
+
+} // namespace zutty
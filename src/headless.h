@@ -0,0 +1,36 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "fontpack.h"
+
+namespace zutty
+{
+   // OSC command taking a snapshot in headless mode: OSC 999 ; <name> ST
+   constexpr int Checkpoint_Osc = 999;
+
+   /* Run the terminal without a window (or any X connection) on the
+    * program already started on ptyFd. Frames are rendered offscreen on
+    * the CPU, and written as image snapshots into the directory given by
+    * the -headless option:
+    * - at each checkpoint the program outputs (see Checkpoint_Osc), as
+    *   <name>.png, or as raw RGBA pixels if <name> ends with ".rgba";
+    * - on demand, each time SIGUSR1 is received, as snapshot_<n>.png;
+    * - when the program exits, as exit.png.
+    * A checkpoint is taken as soon as it is parsed, so it shows exactly
+    * the output preceding it.
+    *
+    * Returns the exit status for main ().
+    */
+   int runHeadless (Fontpack* fontpk, int ptyFd);
+
+} // namespace zutty
@@ -18,14 +18,17 @@
 #include "base.h"
 #include "base64.h"
 #include "fontpack.h"
+#include "headless.h"
 #include "options.h"
 #include "pty.h"
 #include "renderer.h"
 #include "selmgr.h"
+#include "softvdev.h"
 #include "vterm.h"
 #include "wm_icons.h"
 
 #include <cassert>
+#include <chrono>
 #include <langinfo.h>
 #include <memory>
 #include <poll.h>
@@ -38,7 +41,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+using zutty::EglPresenter;
 using zutty::Fontpack;
+using zutty::Frame;
+using zutty::GLCharVdev;
 using zutty::MouseTrackingState;
 using zutty::MouseTrackingMode;
 using zutty::MouseTrackingEnc;
@@ -47,15 +53,19 @@ using zutty::VtKey;
 using zutty::VtModifier;
 using zutty::Renderer;
 using zutty::SelectionManager;
+using zutty::SoftCharVdev;
 
 static std::unique_ptr <Fontpack> fontpk = nullptr;
 static std::unique_ptr <Renderer> renderer = nullptr;
+static std::unique_ptr <EglPresenter> eglPresenter = nullptr;
 static std::unique_ptr <Vterm> vt = nullptr;
 static std::unique_ptr <SelectionManager> selMgr = nullptr;
 
 static Display* xDisplay = nullptr;
 static Window xWindow;
 static Atom wmDeleteMessage;
+static Atom netWmState;
+static Atom netWmStateHidden;
 static XWMHints wmHints;
 static XSizeHints sizeHints;
 static Colormap colormap;
@@ -131,6 +141,50 @@ setXWindowIconName (const std::string & name)
    setUtf8prop ("_NET_WM_ICON_NAME", name);
 }
 
+static void
+makeEglSurface (EGLDisplay eglDpy, EGLConfig config, int width, int height,
+                EGLContext& eglCtx, EGLSurface& eglSurface)
+{
+   static const EGLint ctxAttrs [] = {
+      EGL_CONTEXT_CLIENT_VERSION, 2,
+      EGL_NONE
+   };
+
+   eglBindAPI (EGL_OPENGL_ES_API);
+
+   eglCtx = eglCreateContext (eglDpy, config, EGL_NO_CONTEXT, ctxAttrs);
+   if (!eglCtx)
+   {
+      logE << "eglCreateContext failed" << std::endl;
+      exit (1);
+   }
+
+   // test eglQueryContext()
+   {
+      EGLint val;
+      eglQueryContext (eglDpy, eglCtx, EGL_CONTEXT_CLIENT_TYPE, &val);
+      assert (val == EGL_OPENGL_ES_API);
+   }
+
+   eglSurface = eglCreateWindowSurface (eglDpy, config,
+                                        (EGLNativeWindowType)xWindow, nullptr);
+   if (! eglSurface) {
+      logE << "eglCreateWindowSurface failed" << std::endl;
+      exit (1);
+   }
+
+   // sanity checks
+   {
+      EGLint val;
+      eglQuerySurface (eglDpy, eglSurface, EGL_WIDTH, &val);
+      assert (val == width);
+      eglQuerySurface (eglDpy, eglSurface, EGL_HEIGHT, &val);
+      assert (val == height);
+      assert (eglGetConfigAttrib (eglDpy, config, EGL_SURFACE_TYPE, &val));
+      assert (val & EGL_WINDOW_BIT);
+   }
+}
+
 static void
 makeXWindow (const char* name, int width, int height, int px, int py,
              EGLDisplay eglDpy, EGLContext& eglCtx, EGLSurface& eglSurface)
@@ -142,40 +196,51 @@ makeXWindow (const char* name, int width, int height, int px, int py,
       EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
       EGL_NONE
    };
-   static const EGLint ctxAttrs [] = {
-      EGL_CONTEXT_CLIENT_VERSION, 2,
-      EGL_NONE
-   };
 
    XSetWindowAttributes attr;
    unsigned long mask;
    Window root;
    XVisualInfo *visInfo, visTemplate;
    int numVisuals;
-   EGLConfig config;
+   EGLConfig config = nullptr;
    EGLint numConfigs;
    EGLint vid;
 
    root = RootWindow (xDisplay, DefaultScreen (xDisplay));
 
-   if (!eglChooseConfig (eglDpy, eglAttrs, &config, 1, &numConfigs))
+   if (opts.softRender)
    {
-      logE << "Couldn't get an EGL visual config" << std::endl;
-      exit(1);
+      // The software renderer draws into 32-bit TrueColor pixels
+      visTemplate.screen = DefaultScreen (xDisplay);
+      visTemplate.depth = 24;
+      visTemplate.c_class = TrueColor;
+      visInfo = XGetVisualInfo (xDisplay,
+                                VisualScreenMask | VisualDepthMask |
+                                VisualClassMask,
+                                &visTemplate, &numVisuals);
    }
+   else
+   {
+      if (!eglChooseConfig (eglDpy, eglAttrs, &config, 1, &numConfigs))
+      {
+         logE << "Couldn't get an EGL visual config" << std::endl;
+         exit(1);
+      }
 
-   assert (config);
-   assert (numConfigs > 0);
+      assert (config);
+      assert (numConfigs > 0);
 
-   if (!eglGetConfigAttrib (eglDpy, config, EGL_NATIVE_VISUAL_ID, &vid))
-   {
-      logE << "eglGetConfigAttrib() failed" << std::endl;
-      exit (1);
-   }
+      if (!eglGetConfigAttrib (eglDpy, config, EGL_NATIVE_VISUAL_ID, &vid))
+      {
+         logE << "eglGetConfigAttrib() failed" << std::endl;
+         exit (1);
+      }
 
-   // The X window visual must match the EGL config
-   visTemplate.visualid = vid;
-   visInfo = XGetVisualInfo (xDisplay, VisualIDMask, &visTemplate, &numVisuals);
+      // The X window visual must match the EGL config
+      visTemplate.visualid = vid;
+      visInfo = XGetVisualInfo (xDisplay, VisualIDMask, &visTemplate,
+                                &numVisuals);
+   }
    if (!visInfo) {
       logE << "Couldn't get X visual" << std::endl;
       exit (1);
@@ -188,7 +253,7 @@ makeXWindow (const char* name, int width, int height, int px, int py,
    attr.colormap = colormap;
    attr.event_mask = StructureNotifyMask | ExposureMask | FocusChangeMask |
       PropertyChangeMask | KeyPressMask | ButtonPressMask | ButtonReleaseMask |
-      PointerMotionMask;
+      PointerMotionMask | VisibilityChangeMask;
    mask = CWBackPixel | CWBorderPixel | CWColormap | CWEventMask;
 
    xWindow = XCreateWindow (xDisplay, root, 0, 0, width, height,
@@ -248,39 +313,11 @@ makeXWindow (const char* name, int width, int height, int px, int py,
    wmDeleteMessage = XInternAtom (xDisplay, "WM_DELETE_WINDOW", False);
    XSetWMProtocols (xDisplay, xWindow, &wmDeleteMessage, 1);
 
-   eglBindAPI (EGL_OPENGL_ES_API);
-
-   eglCtx = eglCreateContext (eglDpy, config, EGL_NO_CONTEXT, ctxAttrs);
-   if (!eglCtx)
-   {
-      logE << "eglCreateContext failed" << std::endl;
-      exit (1);
-   }
-
-   // test eglQueryContext()
-   {
-      EGLint val;
-      eglQueryContext (eglDpy, eglCtx, EGL_CONTEXT_CLIENT_TYPE, &val);
-      assert (val == EGL_OPENGL_ES_API);
-   }
-
-   eglSurface = eglCreateWindowSurface (eglDpy, config,
-                                        (EGLNativeWindowType)xWindow, nullptr);
-   if (! eglSurface) {
-      logE << "eglCreateWindowSurface failed" << std::endl;
-      exit (1);
-   }
+   netWmState = XInternAtom (xDisplay, "_NET_WM_STATE", False);
+   netWmStateHidden = XInternAtom (xDisplay, "_NET_WM_STATE_HIDDEN", False);
 
-   // sanity checks
-   {
-      EGLint val;
-      eglQuerySurface (eglDpy, eglSurface, EGL_WIDTH, &val);
-      assert (val == width);
-      eglQuerySurface (eglDpy, eglSurface, EGL_HEIGHT, &val);
-      assert (val == height);
-      assert (eglGetConfigAttrib (eglDpy, config, EGL_SURFACE_TYPE, &val));
-      assert (val & EGL_WINDOW_BIT);
-   }
+   if (!opts.softRender)
+      makeEglSurface (eglDpy, config, width, height, eglCtx, eglSurface);
 
    XFree (visInfo);
 
@@ -475,6 +512,54 @@ pasteCb (bool success, const std::string& content)
       vt->pasteSelection (content);
 }
 
+// Take ownership of the primary selection (and the clipboard, in
+// autoCopy mode), with its text extracted only when requested
+static void
+ownSelection (const std::shared_ptr <Frame::SelectedText>& selectedText,
+              Time time)
+{
+   selMgr->setSelection (selMgr->getPrimary (), time,
+                         [selectedText] (std::string& content)
+                         {
+                            selectedText->take (content);
+                         });
+   if (opts.autoCopyMode)
+      selMgr->copySelection (selMgr->getClipboard (), selMgr->getPrimary ());
+}
+
+// Keys are used to edit the pattern and navigate while searching
+static void
+onSearchKeyPress (KeySym ks, VtModifier mod, const char* buffer)
+{
+   const bool shift = (mod & VtModifier::shift) == VtModifier::shift;
+   switch (ks)
+   {
+   case XK_Escape:
+      vt->searchEnd ();
+      break;
+   case XK_Return:
+   case XK_KP_Enter:
+      vt->searchNext (!shift);
+      break;
+   case XK_Up:
+      vt->searchNext (true);
+      break;
+   case XK_Down:
+      vt->searchNext (false);
+      break;
+   case XK_BackSpace:
+      vt->searchErase ();
+      break;
+   default:
+      if (ks == XK_r && mod == VtModifier::control)
+         vt->searchToggleRegex ();
+      else if ((mod & VtModifier::control) == VtModifier::none &&
+               (unsigned char)buffer [0] >= ' ' && buffer [0] != 0x7f)
+         vt->searchInput (buffer);
+      break;
+   }
+}
+
 static bool
 onKeyPress (XEvent& event, XIC& xic, int ptyFd)
 {
@@ -538,6 +623,23 @@ onKeyPress (XEvent& event, XIC& xic, int ptyFd)
       vt->selectRectangularModeToggle ();
       return false;
    }
+   if (ks == XK_F && mod == VtModifier::shift_control)
+   {
+      vt->searchStart ();
+      return false;
+   }
+   if ((ks == XK_Z || ks == XK_X) && mod == VtModifier::shift_control)
+   {
+      vt->jumpToPrompt (ks == XK_Z);
+      return false;
+   }
+   if (ks == XK_O && mod == VtModifier::shift_control)
+   {
+      std::shared_ptr <Frame::SelectedText> selectedText;
+      if (vt->selectCommandOutput (selectedText))
+         ownSelection (selectedText, xkevt.time);
+      return false;
+   }
 
    if (! (xkevt.state & Mod2Mask)) // NumLock is off
    {
@@ -567,6 +669,12 @@ onKeyPress (XEvent& event, XIC& xic, int ptyFd)
    if (ks == XK_Num_Lock)
       return false;
 
+   if (vt->isSearchActive ())
+   {
+      onSearchKeyPress (ks, mod, buffer);
+      return false;
+   }
+
    switch (ks)
    {
 #define KEYSEND(XKey, VtKey)                    \
@@ -730,6 +838,15 @@ struct MouseContext
    Time lastButtonReleasedAt = 0;
    unsigned int lastButtonReleased = 0;
    bool selectionOngoing = false;
+
+   // rate limit motion reports sent to the application; a report held
+   // back by the limit is sent once due, so the final position is kept
+   constexpr const static int Motion_Report_Interval_Ms = 10;
+   std::chrono::steady_clock::time_point lastMotionReportAt;
+   bool motionReportPending = false;
+   unsigned int motionReportState = 0;
+   uint16_t motionReportCx = 0;
+   uint16_t motionReportCy = 0;
 };
 static MouseContext mouseCtx;
 
@@ -813,12 +930,44 @@ mouseProtoConvCoords (int px, int py, uint16_t& out_cx, uint16_t& out_cy)
    out_cy = std::max (0, (py - opts.border - 1) / fontpk->getPy ()) + 1;
 }
 
+// Send the held back motion report (if any) once due, or right away if
+// forced. Return the number of milliseconds until it is due, or -1.
+static int
+flushMotionReport (bool force = false)
+{
+   using namespace std::chrono;
+
+   if (!mouseCtx.motionReportPending)
+      return -1;
+
+   const auto& mouseTrk = vt->getMouseTrackingState ();
+   if (mouseTrk.mode != MouseTrackingMode::VT200_ButtonEvent &&
+       mouseTrk.mode != MouseTrackingMode::VT200_AnyEvent)
+   {
+      mouseCtx.motionReportPending = false;
+      return -1;
+   }
+
+   const auto now = steady_clock::now ();
+   const auto due = mouseCtx.lastMotionReportAt +
+      milliseconds (MouseContext::Motion_Report_Interval_Ms);
+   if (!force && now < due)
+      return duration_cast <milliseconds> (due - now).count () + 1;
+
+   mouseProtoSend (mouseTrk.enc, MotionNotify, mouseCtx.motionReportState,
+                   0, mouseCtx.motionReportCx, mouseCtx.motionReportCy);
+   mouseCtx.motionReportPending = false;
+   mouseCtx.lastMotionReportAt = now;
+   return -1;
+}
+
 static inline void
 onButtonPressMouseProto (XButtonEvent& xbevt,
                          const MouseTrackingState& mouseTrk)
 {
    uint16_t cx, cy;
 
+   flushMotionReport (true);
    if (xbevt.button > 11)
       return;
 
@@ -846,6 +995,7 @@ onButtonReleaseMouseProto (XButtonEvent& xbevt,
 {
    uint16_t cx, cy;
 
+   flushMotionReport (true);
    if (xbevt.button > 3)
       return;
 
@@ -882,8 +1032,11 @@ onMotionNotifyMouseProto (XMotionEvent& xmoevt,
       mouseProtoConvCoords (xmoevt.x, xmoevt.y, cx, cy);
       if (cx != lastCx || cy != lastCy)
       {
-         mouseProtoSend (mouseTrk.enc, MotionNotify,
-                         xmoevt.state, 0, cx, cy);
+         mouseCtx.motionReportPending = true;
+         mouseCtx.motionReportState = xmoevt.state;
+         mouseCtx.motionReportCx = cx;
+         mouseCtx.motionReportCy = cy;
+         flushMotionReport ();
          lastCx = cx;
          lastCy = cy;
       }
@@ -941,16 +1094,11 @@ onButtonRelease (XButtonEvent& xbevt, bool& holdPtyIn)
    {
    case 1: case 3:
    {
-      std::string utf8_sel;
+      std::shared_ptr <Frame::SelectedText> selectedText;
       holdPtyIn = false;
       mouseCtx.selectionOngoing = false;
-      if (vt->selectFinish (utf8_sel))
-      {
-         selMgr->setSelection (selMgr->getPrimary (), xbevt.time, utf8_sel);
-         if (opts.autoCopyMode)
-            selMgr->copySelection (selMgr->getClipboard (),
-                                   selMgr->getPrimary ());
-      }
+      if (vt->selectFinish (selectedText))
+         ownSelection (selectedText, xbevt.time);
    }
    break;
    case 2:
@@ -972,6 +1120,46 @@ onMotionNotify (XMotionEvent& xmoevt)
       vt->selectUpdate (xmoevt.x, xmoevt.y);
 }
 
+// Rendering is suspended while the window cannot be seen
+struct WindowVisibility
+{
+   bool mapped = true;
+   bool obscured = false; // fully covered by other windows
+   bool hidden = false;   // _NET_WM_STATE_HIDDEN (e.g. iconified)
+};
+static WindowVisibility winVis;
+
+static void
+updateVisibility ()
+{
+   vt->setVisible (winVis.mapped && !winVis.obscured && !winVis.hidden);
+}
+
+static bool
+isNetWmStateHidden ()
+{
+   Atom type;
+   int format;
+   unsigned long nItems, bytesAfter;
+   unsigned char* data = nullptr;
+   bool hidden = false;
+
+   if (XGetWindowProperty (xDisplay, xWindow, netWmState, 0, 1024, False,
+                           XA_ATOM, &type, &format, &nItems, &bytesAfter,
+                           &data) == Success && data)
+   {
+      if (type == XA_ATOM && format == 32)
+      {
+         const Atom* atoms = (const Atom*) data;
+         for (unsigned long k = 0; k < nItems; ++k)
+            if (atoms [k] == netWmStateHidden)
+               hidden = true;
+      }
+      XFree (data);
+   }
+   return hidden;
+}
+
 static bool
 x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
 {
@@ -997,6 +1185,11 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       }
       break;
    case ConfigureNotify:
+      // Only act on the latest of a burst of size changes (e.g. when the
+      // window is being resized interactively).
+      while (XCheckTypedWindowEvent (xDisplay, xWindow, ConfigureNotify,
+                                     &event))
+         ;
       vt->resize (event.xconfigure.width, event.xconfigure.height);
       if (sizeHints.width != event.xconfigure.width ||
           sizeHints.height != event.xconfigure.height)
@@ -1016,9 +1209,18 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       break;
    case MapNotify:
       logT << "MapNotify" << std::endl;
+      winVis.mapped = true;
+      updateVisibility ();
       break;
    case UnmapNotify:
       logT << "UnmapNotify" << std::endl;
+      winVis.mapped = false;
+      updateVisibility ();
+      break;
+   case VisibilityNotify:
+      logT << "VisibilityNotify: " << event.xvisibility.state << std::endl;
+      winVis.obscured = event.xvisibility.state == VisibilityFullyObscured;
+      updateVisibility ();
       break;
    case DestroyNotify:
       logT << "DestroyNotify" << std::endl;
@@ -1035,6 +1237,16 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       onButtonRelease (event.xbutton, holdPtyIn);
       break;
    case MotionNotify:
+      // Of a run of queued motion events, only the newest one matters
+      while (XEventsQueued (event.xmotion.display, QueuedAfterReading))
+      {
+         XEvent next;
+         XPeekEvent (event.xmotion.display, &next);
+         if (next.type != MotionNotify ||
+             next.xmotion.window != event.xmotion.window)
+            break;
+         XNextEvent (event.xmotion.display, &event);
+      }
       onMotionNotify (event.xmotion);
       break;
    case FocusIn:
@@ -1048,6 +1260,13 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       vt->setHasFocus (false);
       break;
    case PropertyNotify:
+      if (event.xproperty.window == xWindow &&
+          event.xproperty.atom == netWmState)
+      {
+         winVis.hidden = isNetWmStateHidden ();
+         updateVisibility ();
+         break;
+      }
       selMgr->onPropertyNotify (event.xproperty);
       break;
    case SelectionClear:
@@ -1067,7 +1286,7 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
    }
 
    if (exposed && redraw) {
-      vt->redraw ();
+      vt->redraw (event.type == Expose);
    }
 
    return false;
@@ -1083,13 +1302,22 @@ eventLoop (XIC& xic, int ptyFd)
    struct pollfd pollset [] = {
       {ptyFd, POLLIN, 0},
       {x11Fd, POLLIN, 0},
+      {-1, POLLIN, 0}, // search results
+      {-1, POLLOUT, 0}, // pty output queue
    };
 
    bool holdPtyIn = false;
    while (1)
    {
       pollset [0].fd = holdPtyIn ? -ptyFd : ptyFd;
-      if (poll (pollset, 2, -1) < 0)
+      pollset [2].fd = vt->getSearchFd ();
+      pollset [3].fd = vt->hasPtyOutput () ? ptyFd : -1;
+      int timeout = -1;
+      for (int t: {vt->flushPtyResize (), vt->expirePredictions (),
+                   flushMotionReport ()})
+         if (t >= 0 && (timeout < 0 || t < timeout))
+            timeout = t;
+      if (poll (pollset, 4, timeout) < 0)
       {
          if (errno == EINTR)
             continue;
@@ -1097,10 +1325,17 @@ eventLoop (XIC& xic, int ptyFd)
             return false;
       }
 
+      if (pollset [3].revents & (POLLOUT | POLLERR | POLLHUP))
+         if (vt->flushPtyOutput ())
+            return false;
+
       if (pollset [0].revents & (POLLIN | POLLHUP))
          if (vt->readPty ())
             return false;
 
+      if (pollset [2].revents & POLLIN)
+         vt->searchFetchResults ();
+
       if (pollset [1].revents & POLLIN)
          while (XPending (xDisplay))
          {
@@ -1262,6 +1497,7 @@ handleXError (Display* dpy, XErrorEvent* ev)
    fflush (stdout);
 
    renderer = nullptr; // ~Renderer () shuts down renderer thread
+   eglPresenter = nullptr;
    exit (1);
    return 0;
 }
@@ -1274,6 +1510,7 @@ handleXIOError (Display* dpy)
         << ") on X server " << DisplayString (dpy) << std::endl;
 
    renderer = nullptr; // ~Renderer () shuts down renderer thread
+   eglPresenter = nullptr;
    exit (1);
    return 0;
 }
@@ -1281,9 +1518,9 @@ handleXIOError (Display* dpy)
 int
 main (int argc, char* argv[])
 {
-   EGLSurface eglSurface;
-   EGLContext eglCtx;
-   EGLDisplay eglDpy;
+   EGLSurface eglSurface = EGL_NO_SURFACE;
+   EGLContext eglCtx = EGL_NO_CONTEXT;
+   EGLDisplay eglDpy = EGL_NO_DISPLAY;
    EGLint eglMajor, eglMinor;
    XIC xic = nullptr;
    XIM xim;
@@ -1323,22 +1560,25 @@ main (int argc, char* argv[])
    XSetIOErrorHandler(handleXIOError);
 
    opts.initialize (&argc, argv);
-   if (!opts.display)
+   if (!opts.headless)
    {
-      opts.handlePrintOpts ();
-      std::cout << "Error: DISPLAY not set!" << std::endl;
-      return -1;
-   }
+      if (!opts.display)
+      {
+         opts.handlePrintOpts ();
+         std::cout << "Error: DISPLAY not set!" << std::endl;
+         return -1;
+      }
 
-   xDisplay = XOpenDisplay (opts.display);
-   if (!xDisplay)
-   {
-      opts.handlePrintOpts ();
-      std::cout << "Error: couldn't open display '" << opts.display << "'"
-                << std::endl;
-      return -1;
+      xDisplay = XOpenDisplay (opts.display);
+      if (!xDisplay)
+      {
+         opts.handlePrintOpts ();
+         std::cout << "Error: couldn't open display '" << opts.display << "'"
+                   << std::endl;
+         return -1;
+      }
+      opts.setDisplay (xDisplay);
    }
-   opts.setDisplay (xDisplay);
 
    opts.parse ();
 
@@ -1369,17 +1609,31 @@ main (int argc, char* argv[])
       validateShell (progPath);
    }
 
-   eglDpy = eglGetDisplay ((EGLNativeDisplayType)xDisplay);
-   if (!eglDpy)
+   if (opts.headless)
    {
-      logE << "eglGetDisplay() failed" << std::endl;
-      return -1;
+      // N.B.: no X connection; X resources are not consulted for options
+      fontpk = std::make_unique <Fontpack> (opts.fontpath, opts.fontname,
+                                            opts.dwfontname,
+                                            opts.synthStyles);
+      setupSignals ();
+      int ptyFd = startShell (progPath, shArgv);
+      return zutty::runHeadless (fontpk.get (), ptyFd);
    }
 
-   if (!eglInitialize (eglDpy, &eglMajor, &eglMinor))
+   if (!opts.softRender)
    {
-      logE << "eglInitialize() failed" << std::endl;
-      return -1;
+      eglDpy = eglGetDisplay ((EGLNativeDisplayType)xDisplay);
+      if (!eglDpy)
+      {
+         logE << "eglGetDisplay() failed" << std::endl;
+         return -1;
+      }
+
+      if (!eglInitialize (eglDpy, &eglMajor, &eglMinor))
+      {
+         logE << "eglInitialize() failed" << std::endl;
+         return -1;
+      }
    }
 
    xim = XOpenIM (xDisplay, nullptr, nullptr, nullptr);
@@ -1417,7 +1671,7 @@ main (int argc, char* argv[])
    }
 
    fontpk = std::make_unique <Fontpack> (opts.fontpath, opts.fontname,
-                                         opts.dwfontname);
+                                         opts.dwfontname, opts.synthStyles);
 
    int winWidth = 2 * opts.border + opts.nCols * fontpk->getPx ();
    int winHeight = 2 * opts.border + opts.nRows * fontpk->getPy ();
@@ -1440,7 +1694,8 @@ main (int argc, char* argv[])
       }
    }
 
-   if (!eglMakeCurrent(eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT))
+   if (!opts.softRender &&
+       !eglMakeCurrent(eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT))
    {
       logE << "eglMakeCurrent() failed" << std::endl;
       return -1;
@@ -1448,21 +1703,40 @@ main (int argc, char* argv[])
 
    selMgr = std::make_unique <SelectionManager> (xDisplay, xWindow);
 
-   renderer = std::make_unique <Renderer> (
-      [eglDpy, eglSurface, eglCtx] ()
-      {
-         if (!eglMakeCurrent (eglDpy, eglSurface, eglSurface, eglCtx))
-            throw std::runtime_error ("Error: eglMakeCurrent() failed");
-         if (!eglSwapInterval (eglDpy, 0))
-            throw std::runtime_error ("Error: eglSwapInterval() failed");
-         if (opts.glinfo)
-            printGLInfo (eglDpy);
-      },
-      [eglDpy, eglSurface] ()
-      {
-         eglSwapBuffers (eglDpy, eglSurface);
-      },
-      fontpk.get ());
+   if (opts.softRender)
+   {
+      // N.B.: SoftCharVdev::draw () presents the frame in the window
+      renderer = std::make_unique <Renderer> (
+         [] () {},
+         [] (const std::vector <zutty::Rect>&) {},
+         [] () -> std::unique_ptr <zutty::CharVdev>
+         {
+            return std::make_unique <SoftCharVdev> (fontpk.get (), xWindow);
+         });
+   }
+   else
+   {
+      eglPresenter = std::make_unique <EglPresenter> (eglDpy, eglSurface);
+      EglPresenter* presenter = eglPresenter.get ();
+      renderer = std::make_unique <Renderer> (
+         [eglDpy, eglSurface, eglCtx] ()
+         {
+            if (!eglMakeCurrent (eglDpy, eglSurface, eglSurface, eglCtx))
+               throw std::runtime_error ("Error: eglMakeCurrent() failed");
+            if (!eglSwapInterval (eglDpy, 0))
+               throw std::runtime_error ("Error: eglSwapInterval() failed");
+            if (opts.glinfo)
+               printGLInfo (eglDpy);
+         },
+         [presenter] (const std::vector <zutty::Rect>& damage)
+         {
+            presenter->swapBuffers (damage);
+         },
+         [presenter] () -> std::unique_ptr <zutty::CharVdev>
+         {
+            return std::make_unique <GLCharVdev> (fontpk.get (), presenter);
+         });
+   }
 
    setupSignals ();
    int ptyFd = startShell (progPath, shArgv);
@@ -1479,10 +1753,14 @@ main (int argc, char* argv[])
    bool destroyed = eventLoop (xic, ptyFd);
 
    renderer = nullptr; // ~Renderer () shuts down renderer thread
+   eglPresenter = nullptr;
 
-   eglDestroyContext (eglDpy, eglCtx);
-   eglDestroySurface (eglDpy, eglSurface);
-   eglTerminate (eglDpy);
+   if (!opts.softRender)
+   {
+      eglDestroyContext (eglDpy, eglCtx);
+      eglDestroySurface (eglDpy, eglSurface);
+      eglTerminate (eglDpy);
+   }
 
    if (! destroyed)
       XDestroyWindow (xDisplay, xWindow);
@@ -234,6 +234,8 @@ namespace zutty
       if (display)
          setenv ("DISPLAY", display, 1);
 
+      headless = get ("headless");
+
       name = get ("name", getenv ("RESOURCE_NAME"));
       if (name && (strchr (name, '.') || strchr (name, '*')))
          throw std::runtime_error ("-name: supplied value contains "
@@ -335,7 +337,10 @@ namespace zutty
          bellIsUrgent = getBool ("bellIsUrgent");
          boldColors = getBool ("boldColors");
          login = getBool ("login");
+         predictEcho = getBool ("predictEcho");
          showWraps = getBool ("showWraps");
+         softRender = getBool ("softRender");
+         synthStyles = getBool ("synthStyles");
          quiet = getBool ("quiet");
          verbose = getBool ("verbose");
          modifyOtherKeys = getInteger ("modifyOtherKeys", 0, 2);
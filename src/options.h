@@ -66,14 +66,18 @@ namespace zutty
       {"fontpath",    SepArg,   nullptr,   fontpath,  "Font search path"},
       {"geometry",    SepArg,   nullptr,   "80x24",   "Terminal size in chars"},
       {"glinfo",      NoArg,    "true",    "false",   "Print OpenGL information"},
+      {"headless",    SepArg,   nullptr,   nullptr,   "Run without X, saving snapshots to dir"},
       {"help",        NoArg,    "true",    "false",   "Print usage listing and quit"},
       {"listres",     NoArg,    "true",    "false",   "Print resource listing and quit"},
       {"login",       NoArg,    "true",    "false",   "Start shell as a login shell"},
       {"name",        SepArg,   nullptr,   nullptr,   "Instance name for Xrdb and WM_CLASS"},
+      {"predictEcho", NoArg,    "true",    "false",   "Predictive local echo"},
       {"rv",          NoArg,    "true",    "false",   "Reverse video"},
       {"saveLines",   SepArg,   nullptr,   "500",     "Lines of scrollback history"},
       {"shell",       SepArg,   nullptr,   nullptr,   "Shell program to run"},
       {"showWraps",   NoArg,    "true",    "false",   "Show wrap marks at right margin"},
+      {"softRender",  NoArg,    "true",    "false",   "Render on the CPU, without OpenGL"},
+      {"synthStyles", NoArg,    "true",    "false",   "Synthesize bold and italic from regular"},
       {"title",       SepArg,   nullptr,   "Zutty",   "Window title"},
       {"T",           SepArg,   nullptr,   nullptr,   "Equivalent to -title"},
       {"quiet",       NoArg,    "true",    "false",   "Silence logging output"},
@@ -126,6 +130,7 @@ namespace zutty
       const char* dwfontname;
       const char* fontname;
       const char* fontpath;
+      const char* headless;
       const char* name;
       const char* shell;
       const char* title;
@@ -141,7 +146,10 @@ namespace zutty
       bool boldColors;
       bool glinfo;
       bool login;
+      bool predictEcho;
       bool showWraps;
+      bool softRender;
+      bool synthStyles;
       bool quiet;
       bool rv;
       bool verbose;
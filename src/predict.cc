@@ -0,0 +1,278 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "log.h"
+#include "predict.h"
+
+#include <algorithm>
+
+namespace
+{
+   using namespace std::chrono;
+
+   // Longer input (e.g. a paste) is not predicted
+   constexpr const size_t maxInputLength = 8;
+
+   // Echo latency (ms) above/below which predictions are shown/hidden
+   constexpr const double flagOnLatency = 30;
+   constexpr const double flagOffLatency = 20;
+
+   // Bounds of the time allowed for a prediction to be confirmed
+   const milliseconds minTimeout (250);
+   const milliseconds maxTimeout (2000);
+
+} // namespace
+
+namespace zutty
+{
+   void
+   EchoPredictor::input (const uint8_t* buf, size_t len, const Frame& frame,
+                         uint16_t posX, uint16_t posY,
+                         const CharVdev::Cell& attrs)
+   {
+      using Kind = Prediction::Kind;
+
+      if (len > maxInputLength || posY >= frame.nRows)
+      {
+         reset ();
+         return;
+      }
+
+      uint16_t pY = posY;
+      uint16_t pX = posX;
+      if (!pending.empty ())
+      {
+         pY = pending.back ().pY;
+         pX = pending.back ().curX;
+      }
+
+      // Is the predicted row blank from pX onwards?
+      auto atEndOfLine =
+         [&] ()
+         {
+            for (uint16_t x = pX; x < frame.nCols; ++x)
+               if (predictedChar (frame, pY, x) != ' ')
+                  return false;
+            return true;
+         };
+
+      const auto now = Clock::now ();
+      const uint8_t* const end = buf + len;
+      for (const uint8_t* p = buf; p < end; ++p)
+      {
+         Prediction pr;
+         pr.pY = pY;
+         pr.prevChar = 0;
+         pr.sentAt = now;
+
+         if (*p >= 0x20 && *p < 0x7f)
+         {
+            if (pX + 1 >= frame.nCols || !atEndOfLine ())
+            {
+               reset (); // wrapping or inserting into text
+               return;
+            }
+            pr.kind = Kind::Char;
+            pr.pX = pX;
+            pr.curX = ++pX;
+            pr.cell = attrs;
+            pr.cell.uc_pt = *p;
+            pr.cell.underline = 1;
+            pr.cell.dwidth = 0;
+            pr.cell.dwidth_cont = 0;
+            pr.cell.wrap = 0;
+         }
+         else if (*p == 0x7f || *p == '\b')
+         {
+            if (pX == 0 || pX >= frame.nCols || !atEndOfLine ())
+            {
+               reset ();
+               return;
+            }
+            pr.kind = Kind::Erase;
+            pr.pX = pr.curX = --pX;
+            pr.prevChar = frame.getCell (pY, pX).uc_pt;
+            pr.cell = attrs;
+            pr.cell.uc_pt = ' ';
+            pr.cell.underline = 0;
+            pr.cell.dwidth = 0;
+            pr.cell.dwidth_cont = 0;
+            pr.cell.wrap = 0;
+         }
+         else if (*p == '\e' && end - p == 3 && (p [1] == '[' || p [1] == 'O') &&
+                  (p [2] == 'C' || p [2] == 'D'))
+         {
+            if (p [2] == 'D' && pX > 0)
+               --pX; // Left
+            else if (p [2] == 'C' && pX + 1 < frame.nCols &&
+                     predictedChar (frame, pY, pX) != ' ')
+               ++pX; // Right, over existing text
+            else
+               return;
+            pr.kind = Kind::Cursor;
+            pr.pX = pr.curX = pX;
+            p += 2;
+         }
+         else
+         {
+            reset (); // e.g. Return, control or other keys
+            return;
+         }
+         pending.push_back (pr);
+      }
+   }
+
+   void
+   EchoPredictor::check (const Frame& frame, uint16_t posX, uint16_t posY)
+   {
+      if (pending.empty ())
+         return;
+
+      // Everything up to the last confirmed prediction has been echoed
+      auto it = std::find_if (pending.rbegin (), pending.rend (),
+                              [&] (const Prediction& pr)
+                              {
+                                 return isConfirmed (pr, frame, posX, posY);
+                              });
+      if (it != pending.rend ())
+      {
+         // The cursor might be where predicted by mere chance, so only
+         // changes of content count as evidence of the program echoing
+         if (it->kind != Prediction::Kind::Cursor)
+         {
+            const double sample = duration <double, std::milli> (
+               Clock::now () - it->sentAt).count ();
+            srtt = srtt ? (7 * srtt + sample) / 8 : sample;
+            if (srtt > flagOnLatency)
+               flagging = true;
+            else if (srtt < flagOffLatency)
+               flagging = false;
+
+            confirmedEpoch = epoch;
+         }
+         pending.erase (pending.begin (), it.base ());
+      }
+
+      // A character that has been passed over by the cursor, but is not
+      // what was predicted, means that our model of the program is wrong
+      for (const Prediction& pr: pending)
+      {
+         if (pr.kind != Prediction::Kind::Char || pr.pY >= frame.nRows)
+            continue;
+         if ((posY > pr.pY || (posY == pr.pY && posX > pr.pX)) &&
+             frame.getCell (pr.pY, pr.pX).uc_pt != pr.cell.uc_pt)
+         {
+            logT << "EchoPredictor: misprediction at (" << pr.pX << ","
+                 << pr.pY << ")" << std::endl;
+            reset ();
+            return;
+         }
+      }
+   }
+
+   int
+   EchoPredictor::expire ()
+   {
+      if (pending.empty ())
+         return -1;
+
+      const auto due = pending.front ().sentAt + getTimeout ();
+      const auto now = Clock::now ();
+      if (now >= due)
+      {
+         logT << "EchoPredictor: no echo in time" << std::endl;
+         reset ();
+         return -1;
+      }
+      return duration_cast <milliseconds> (due - now).count () + 1;
+   }
+
+   void
+   EchoPredictor::reset ()
+   {
+      pending.clear ();
+      ++epoch;
+   }
+
+   bool
+   EchoPredictor::isShown () const
+   {
+      return !pending.empty () && flagging && confirmedEpoch == epoch;
+   }
+
+   void
+   EchoPredictor::getOverlay (Frame::Overlay& overlay, Point& cursor) const
+   {
+      overlay.clear ();
+      for (const Prediction& pr: pending)
+      {
+         cursor = Point (pr.curX, pr.pY);
+         if (pr.kind == Prediction::Kind::Cursor)
+            continue;
+
+         // Later predictions supersede earlier ones for the same cell
+         auto it = std::find_if (overlay.begin (), overlay.end (),
+                                 [&] (const Frame::OverlayCell& oc)
+                                 {
+                                    return oc.pY == pr.pY && oc.pX == pr.pX;
+                                 });
+         if (it != overlay.end ())
+            it->cell = pr.cell;
+         else
+            overlay.push_back ({pr.pY, pr.pX, pr.cell});
+      }
+   }
+
+   // private methods
+
+   uint16_t
+   EchoPredictor::predictedChar (const Frame& frame, uint16_t pY,
+                                 uint16_t pX) const
+   {
+      for (auto it = pending.rbegin (); it != pending.rend (); ++it)
+         if (it->kind != Prediction::Kind::Cursor &&
+             it->pY == pY && it->pX == pX)
+            return it->cell.uc_pt;
+      return frame.getCell (pY, pX).uc_pt;
+   }
+
+   bool
+   EchoPredictor::isConfirmed (const Prediction& pr, const Frame& frame,
+                               uint16_t posX, uint16_t posY) const
+   {
+      if (posY != pr.pY || pr.pY >= frame.nRows)
+         return false;
+
+      switch (pr.kind)
+      {
+      case Prediction::Kind::Char:
+         // N.B.: a blank cell might match already, so the cursor must
+         // have moved past it as well
+         return posX > pr.pX &&
+                frame.getCell (pr.pY, pr.pX).uc_pt == pr.cell.uc_pt;
+      case Prediction::Kind::Erase:
+         // N.B.: only erasing actual content can be confirmed
+         return pr.prevChar != ' ' && posX <= pr.pX &&
+                frame.getCell (pr.pY, pr.pX).uc_pt == ' ';
+      case Prediction::Kind::Cursor:
+         return posX == pr.curX;
+      }
+      return false;
+   }
+
+   EchoPredictor::Clock::duration
+   EchoPredictor::getTimeout () const
+   {
+      const milliseconds timeout ((int)(3 * srtt));
+      return std::min (maxTimeout, std::max (minTimeout, timeout));
+   }
+
+} // namespace zutty
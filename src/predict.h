@@ -0,0 +1,89 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "frame.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+namespace zutty
+{
+   /* Speculative local echo, in the spirit of mosh: the effect of user
+    * input on the screen is predicted and displayed right away, then the
+    * predictions are confirmed or discarded once the echo of the program
+    * arrives from the pty.
+    *
+    * Only the simple, common case is predicted: typing and erasing at the
+    * end of a line, and moving the cursor left/right within the line.
+    * Anything else (e.g. Return) discards the pending predictions and
+    * starts a new epoch. Predictions of an epoch are only displayed once
+    * one of them has been confirmed by an echo, so nothing is shown when
+    * the program does not echo (e.g. at a password prompt), and only if
+    * the echo is slow enough for the prediction to make a difference.
+    */
+   class EchoPredictor
+   {
+   public:
+      using Clock = std::chrono::steady_clock;
+
+      // User input that is about to be sent to the pty, with the actual
+      // cursor of the terminal at (posX, posY)
+      void input (const uint8_t* buf, size_t len, const Frame& frame,
+                  uint16_t posX, uint16_t posY, const CharVdev::Cell& attrs);
+
+      // Judge pending predictions against the frame after pty output
+      void check (const Frame& frame, uint16_t posX, uint16_t posY);
+
+      // Discard predictions that have not been confirmed in time. Return
+      // the number of milliseconds until the next one is due, or -1.
+      int expire ();
+
+      // Discard all predictions and start a new (tentative) epoch
+      void reset ();
+
+      bool isShown () const;
+      void getOverlay (Frame::Overlay& overlay, Point& cursor) const;
+
+   private:
+      struct Prediction
+      {
+         enum class Kind: uint8_t
+         {
+            Char,   // cell is written, cursor moves right
+            Erase,  // cell is erased, cursor moves left onto it
+            Cursor  // cursor moves to curX
+         };
+         Kind kind;
+         uint16_t pY;
+         uint16_t pX;
+         uint16_t curX; // predicted cursor column after this
+         uint16_t prevChar; // actual content of the cell when predicted
+         CharVdev::Cell cell;
+         Clock::time_point sentAt;
+      };
+      std::deque <Prediction> pending;
+
+      uint64_t epoch = 1;          // bumped when predictions are discarded
+      uint64_t confirmedEpoch = 0; // last epoch with a confirmed prediction
+      double srtt = 0;             // smoothed echo latency (ms)
+      bool flagging = false;       // is latency high enough to show them?
+
+      uint16_t predictedChar (const Frame& frame, uint16_t pY,
+                              uint16_t pX) const;
+      bool isConfirmed (const Prediction& pr, const Frame& frame,
+                        uint16_t posX, uint16_t posY) const;
+      Clock::duration getTimeout () const;
+   };
+
+} // namespace zutty
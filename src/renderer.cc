@@ -16,10 +16,10 @@
 namespace zutty
 {
    Renderer::Renderer (const std::function <void ()>& initDisplay,
-                       const std::function <void ()>& swapBuffers_,
-                       Fontpack* fontpk)
+                       const SwapBuffersFn& swapBuffers_,
+                       const CreateVdevFn& createVdev)
       : swapBuffers {swapBuffers_}
-      , thr (&Renderer::renderThread, this, initDisplay, fontpk)
+      , thr (&Renderer::renderThread, this, initDisplay, createVdev)
    {
    }
 
@@ -45,11 +45,11 @@ namespace zutty
 
    void
    Renderer::renderThread (const std::function <void ()>& initDisplay,
-                           Fontpack* fontpk)
+                           const CreateVdevFn& createVdev)
    {
       initDisplay ();
 
-      charVdev = std::make_unique <CharVdev> (fontpk);
+      charVdev = createVdev ();
 
       Frame lastFrame;
       bool delta = false;
@@ -66,7 +66,9 @@ namespace zutty
          if (done)
             return;
 
-         if (lastFrame.seqNo + 1 != nextFrame.seqNo)
+         // A full redraw (e.g. on Expose) must present the whole window:
+         // drawing a non-delta frame reports it all as damaged
+         if (lastFrame.seqNo + 1 != nextFrame.seqNo || nextFrame.fullRedraw)
             delta = false;
 
          lastFrame = nextFrame;
@@ -81,7 +83,11 @@ namespace zutty
             assert (m.nRows == lastFrame.nRows);
 
             if (delta)
-               lastFrame.deltaCopyCells (m.cells);
+            {
+               if (lastFrame.getScrollCount () > 0)
+                  charVdev->scrollUp (lastFrame.getScrollCount ());
+               lastFrame.deltaCopyCells (m.cells, m.dirtyCells);
+            }
             else
                lastFrame.fullCopyCells (m.cells);
          }
@@ -93,7 +99,8 @@ namespace zutty
          if (lastFrame.seqNo == nextFrame.seqNo)
          {
             charVdev->draw ();
-            swapBuffers ();
+            if (!charVdev->getDamage ().empty ())
+               swapBuffers (charVdev->getDamage ());
             delta = true;
          }
          else
@@ -20,15 +20,24 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace zutty
 {
    class Renderer
    {
    public:
+      using CreateVdevFn = std::function <std::unique_ptr <CharVdev> ()>;
+      // Present a drawn frame, given its damage (see CharVdev::getDamage ())
+      using SwapBuffersFn = std::function <void (const std::vector <Rect>&)>;
+
+      /* The display is initialized and the CharVdev created (via the
+       * given functions) on the renderer thread, since e.g. a GL context
+       * can only be used from the thread it is made current on.
+       */
       Renderer (const std::function <void ()>& initDisplay,
-                const std::function <void ()>& swapBuffers,
-                Fontpack* fontpk);
+                const SwapBuffersFn& swapBuffers,
+                const CreateVdevFn& createVdev);
 
       ~Renderer ();
 
@@ -36,7 +45,7 @@ namespace zutty
 
    private:
       std::unique_ptr <CharVdev> charVdev;
-      const std::function <void ()> swapBuffers;
+      const SwapBuffersFn swapBuffers;
       Frame nextFrame;
       uint64_t seqNo = 0;
       bool done = false;
@@ -46,7 +55,7 @@ namespace zutty
       std::thread thr;
 
       void renderThread (const std::function <void ()>& initDisplay,
-                         Fontpack* fontpk);
+                         const CreateVdevFn& createVdev);
    };
 
 } // namespace zutty
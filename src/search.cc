@@ -0,0 +1,335 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "log.h"
+#include "search.h"
+
+#include <algorithm>
+#include <regex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   using namespace zutty;
+
+   // Number of code units to scan between publishing results
+   constexpr const int chunkSize = 1 << 16;
+
+   /* Find the first occurrence of ch in [p, end). This is the prefilter
+    * for literal searches: candidate positions are located eight code
+    * units at a time, and only these are compared with the full pattern.
+    */
+   const uint16_t*
+   findCodeUnit (const uint16_t* p, const uint16_t* const end, uint16_t ch)
+   {
+#if defined(__SSE2__)
+      const __m128i needle = _mm_set1_epi16 (ch);
+      for (; p + 8 <= end; p += 8)
+      {
+         __m128i v = _mm_loadu_si128 (reinterpret_cast <const __m128i*> (p));
+         int mask = _mm_movemask_epi8 (_mm_cmpeq_epi16 (v, needle));
+         if (mask)
+            return p + (__builtin_ctz (mask) >> 1);
+      }
+#endif
+      return std::find (p, end, ch);
+   }
+
+   /* Match pattern against row starting at col (where the first code unit
+    * is already known to match). The continuation cells of double-width
+    * characters are skipped. Return the number of cells covered, or zero
+    * if there is no match.
+    */
+   uint16_t
+   matchAt (const uint16_t* row, uint16_t nCols, uint16_t col,
+            const std::u16string& pattern)
+   {
+      uint16_t x = col;
+      for (char16_t pc: pattern)
+      {
+         while (x < nCols && row [x] == TextSnapshot::DWidthCont)
+            ++x;
+         if (x == nCols || row [x] != pc)
+            return 0;
+         ++x;
+      }
+      if (x < nCols && row [x] == TextSnapshot::DWidthCont)
+         ++x;
+      return x - col;
+   }
+
+} // namespace
+
+namespace zutty
+{
+   SearchEngine::SearchEngine ()
+   {
+      if (pipe (notifyPipe) < 0)
+         throw std::runtime_error ("Could not create search notify pipe");
+      for (int fd: notifyPipe)
+         fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+      thr = std::thread (&SearchEngine::workerThread, this);
+   }
+
+   SearchEngine::~SearchEngine ()
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      done = true;
+      ++generation;
+      lk.unlock ();
+      cond.notify_one ();
+      thr.join ();
+
+      close (notifyPipe [0]);
+      close (notifyPipe [1]);
+   }
+
+   void
+   SearchEngine::start (std::shared_ptr <const TextSnapshot> snapshot,
+                        const std::u16string& pattern, bool regex,
+                        int originRow)
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      job.snapshot = std::move (snapshot);
+      job.pattern = pattern;
+      job.regex = regex;
+      job.originRow = originRow;
+      ++generation;
+      results.clear ();
+      state = State::Running;
+      lk.unlock ();
+      cond.notify_one ();
+   }
+
+   void
+   SearchEngine::cancel ()
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      job.snapshot = nullptr;
+      ++generation;
+      results.clear ();
+      state = State::Idle;
+   }
+
+   SearchEngine::State
+   SearchEngine::fetchResults (std::vector <SearchMatch>& matches)
+   {
+      char buf [64];
+      while (read (notifyPipe [0], buf, sizeof (buf)) > 0)
+         ;
+
+      std::unique_lock <std::mutex> lk (mx);
+      matches.insert (matches.end (), results.begin (), results.end ());
+      results.clear ();
+      return state;
+   }
+
+   // private methods
+
+   void
+   SearchEngine::workerThread ()
+   {
+      uint64_t lastGen = 0;
+      while (1)
+      {
+         std::unique_lock <std::mutex> lk (mx);
+         cond.wait (lk, [&] () { return generation != lastGen; });
+
+         if (done)
+            return;
+
+         lastGen = generation;
+         const Job curJob = job;
+         lk.unlock ();
+
+         if (!curJob.snapshot)
+            continue; // cancelled
+
+         bool ok = runJob (curJob, lastGen);
+
+         lk.lock ();
+         if (generation == lastGen)
+         {
+            state = ok ? State::Done : State::Error;
+            lk.unlock ();
+            notify ();
+         }
+      }
+   }
+
+   /* Scan the snapshot in chunks of rows, moving outwards from the origin
+    * row: first the chunk from there downwards (so that the rows in view
+    * come first), then alternating between earlier and later rows. Results
+    * are published after each chunk; scanning stops if the search has been
+    * superseded in the meantime. Return false on an invalid regex, or if
+    * matching it fails.
+    */
+   bool
+   SearchEngine::runJob (const Job& job, uint64_t gen)
+   {
+      const TextSnapshot& snap = *job.snapshot;
+      const uint16_t nCols = snap.nCols;
+      const int nRows = snap.nRows ();
+      const int chunkRows = std::max (1, chunkSize / std::max (1, (int)nCols));
+      const uint16_t* const text = snap.text.data ();
+
+      std::wregex re;
+      if (job.regex)
+      {
+         try
+         {
+            re = std::wregex (std::wstring (job.pattern.begin (),
+                                            job.pattern.end ()));
+         }
+         catch (const std::regex_error& e)
+         {
+            logT << "Search: invalid regex: " << e.what () << std::endl;
+            return false;
+         }
+      }
+
+      std::vector <SearchMatch> found;
+      std::wstring line;
+      std::vector <uint16_t> lineCols;
+
+      auto scanLiteral =
+         [&] (int begin, int end)
+         {
+            const uint16_t* p = text + begin * nCols;
+            const uint16_t* const pEnd = text + end * nCols;
+            while ((p = findCodeUnit (p, pEnd, job.pattern [0])) < pEnd)
+            {
+               const int offset = p - text;
+               const int row = offset / nCols;
+               const uint16_t col = offset % nCols;
+               uint16_t len = matchAt (text + row * nCols, nCols, col,
+                                       job.pattern);
+               if (len)
+               {
+                  found.push_back ({snap.firstRow + row, col, len});
+                  p += len;
+               }
+               else
+                  ++p;
+            }
+         };
+
+      auto scanRegex =
+         [&] (int begin, int end)
+         {
+            for (int row = begin; row < end; ++row)
+            {
+               const uint16_t* rp = text + row * nCols;
+               line.clear ();
+               lineCols.clear ();
+               for (uint16_t x = 0; x < nCols; ++x)
+                  if (rp [x] != TextSnapshot::DWidthCont)
+                  {
+                     line.push_back (rp [x]);
+                     lineCols.push_back (x);
+                  }
+               while (line.size () && line.back () == ' ')
+               {
+                  line.pop_back (); // so that '$' matches at end of text
+                  lineCols.pop_back ();
+               }
+
+               std::wsregex_iterator it (line.begin (), line.end (), re);
+               for (; it != std::wsregex_iterator (); ++it)
+               {
+                  if (!it->length ())
+                     continue;
+                  uint16_t col = lineCols [it->position ()];
+                  uint16_t last = lineCols [it->position () + it->length () - 1];
+                  if (last + 1 < nCols && rp [last + 1] == TextSnapshot::DWidthCont)
+                     ++last;
+                  found.push_back ({snap.firstRow + row, col,
+                                    (uint16_t)(last + 1 - col)});
+               }
+            }
+         };
+
+      auto scan =
+         [&] (int begin, int end)
+         {
+            if (job.regex)
+               scanRegex (begin, end);
+            else
+               scanLiteral (begin, end);
+         };
+
+      int up = std::max (0, std::min (job.originRow - snap.firstRow, nRows));
+      int down = up;
+      try
+      {
+         while (up > 0 || down < nRows)
+         {
+            if (down < nRows)
+            {
+               int end = std::min (down + chunkRows, nRows);
+               scan (down, end);
+               down = end;
+            }
+            if (up > 0)
+            {
+               int begin = std::max (0, up - chunkRows);
+               scan (begin, up);
+               up = begin;
+            }
+            if (!publish (found, gen))
+               break;
+         }
+      }
+      catch (const std::regex_error& e)
+      {
+         // e.g. the regex proved too complex to match against some line
+         logT << "Search: regex matching failed: " << e.what () << std::endl;
+         return false;
+      }
+      return true;
+   }
+
+   bool
+   SearchEngine::publish (std::vector <SearchMatch>& found, uint64_t gen)
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      if (generation != gen)
+         return false;
+
+      if (found.empty ())
+         return true;
+
+      results.insert (results.end (), found.begin (), found.end ());
+      lk.unlock ();
+      found.clear ();
+      notify ();
+      return true;
+   }
+
+   void
+   SearchEngine::notify ()
+   {
+      const char ch = 0;
+      if (write (notifyPipe [1], &ch, 1) < 0)
+      {
+         // The pipe is full, so the reader will be woken up anyway
+      }
+   }
+
+} // namespace zutty
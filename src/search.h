@@ -0,0 +1,99 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zutty
+{
+   // Text content of a range of frame rows, to be searched off-thread
+   struct TextSnapshot
+   {
+      // Placeholder for the continuation half of double-width characters
+      constexpr const static uint16_t DWidthCont = 0xffff;
+
+      uint16_t nCols = 0;
+      int firstRow = 0;       // frame row of the first row (<0: history)
+      int64_t scrollPos = 0;  // frame scroll position when taken
+      std::vector <uint16_t> text; // nCols code units per row
+
+      int nRows () const { return nCols ? text.size () / nCols : 0; }
+   };
+
+   struct SearchMatch
+   {
+      int row;         // frame row at the time of the snapshot
+      uint16_t col;
+      uint16_t length; // number of cells covered
+
+      bool operator < (const SearchMatch& rhs) const
+      {
+         return row < rhs.row || (row == rhs.row && col < rhs.col);
+      }
+   };
+
+   class SearchEngine
+   {
+   public:
+      SearchEngine ();
+      ~SearchEngine ();
+
+      enum class State: uint8_t
+      {
+         Idle, Running, Done, Error
+      };
+
+      // Start a new search (cancelling the ongoing one, if any). Rows are
+      // scanned outwards, starting from the snapshot row at originRow.
+      void start (std::shared_ptr <const TextSnapshot> snapshot,
+                  const std::u16string& pattern, bool regex, int originRow);
+      void cancel ();
+
+      // File descriptor that is readable when there are new results
+      int getNotifyFd () const { return notifyPipe [0]; }
+
+      // Move results found since the last call to the end of matches
+      State fetchResults (std::vector <SearchMatch>& matches);
+
+   private:
+      struct Job
+      {
+         std::shared_ptr <const TextSnapshot> snapshot;
+         std::u16string pattern;
+         bool regex = false;
+         int originRow = 0;
+      };
+      Job job;
+      uint64_t generation = 0; // bumped on each start/cancel
+      bool done = false;
+
+      std::vector <SearchMatch> results;
+      State state = State::Idle;
+      int notifyPipe [2] = { -1, -1 };
+
+      std::condition_variable cond;
+      std::mutex mx;
+      std::thread thr;
+
+      void workerThread ();
+      bool runJob (const Job& job, uint64_t gen);
+      bool publish (std::vector <SearchMatch>& found, uint64_t gen);
+      void notify ();
+   };
+
+} // namespace zutty
@@ -15,6 +15,37 @@
 
 #include <X11/Xmu/Atoms.h>
 
+#include <algorithm>
+
+namespace
+{
+   // How long an outbound INCR transfer may wait for its requestor
+   // to ask for the next chunk before it is dropped.
+   constexpr std::chrono::seconds incrTimeout {10};
+
+   /* The requestor of an INCR transfer might be gone by the time we
+    * write its next chunk, which would make the server send BadWindow
+    * (and the default handler of main exit). Errors on the display
+    * while writing a chunk are thus only noted instead; others are
+    * passed on to the original handler.
+    */
+   Display* incrDpy = nullptr;
+   bool incrFailed = false;
+   XErrorHandler prevErrorHandler = nullptr;
+
+   int
+   incrErrorHandler (Display* dpy, XErrorEvent* ev)
+   {
+      if (dpy == incrDpy)
+      {
+         incrFailed = true;
+         return 0;
+      }
+      return prevErrorHandler ? prevErrorHandler (dpy, ev) : 0;
+   }
+
+} // namespace
+
 namespace zutty
 {
    SelectionManager::SelectionManager (Display* dpy_, Window win_)
@@ -31,8 +62,8 @@ namespace zutty
                    : XMaxRequestSize (dpy) >> 2)
    {
       // N.B.: create map entries:
-      ctx [primary].content = "";
-      ctx [clipboard].content = "";
+      ctx [primary].owned = false;
+      ctx [clipboard].owned = false;
 
       logT << "SelectionManager: chunkSize=" << chunkSize << std::endl;
    }
@@ -45,7 +76,7 @@ namespace zutty
 
       if (cx.owned)
       {
-         cb (true, cx.content);
+         cb (true, cx.content->get ());
          return;
       }
 
@@ -58,13 +89,54 @@ namespace zutty
    bool
    SelectionManager::setSelection (Atom selection,
                                    Time time, const std::string& content_)
+   {
+      return setSelection (selection, time,
+                           [text = content_] (std::string& content) mutable
+                           {
+                              content.swap (text);
+                           });
+   }
+
+   bool
+   SelectionManager::setSelection (Atom selection,
+                                   Time time, ContentFn&& contentFn)
+   {
+      return setOwner (selection, time,
+                       std::make_shared <Content> (std::move (contentFn)));
+   }
+
+   bool
+   SelectionManager::copySelection (Atom dest, Atom source)
+   {
+      Context& cx = ctx [source];
+
+      if (! cx.owned)
+         return false;
+
+      return setOwner (dest, CurrentTime, cx.content);
+   }
+
+   const std::string&
+   SelectionManager::Content::get ()
+   {
+      if (producer)
+      {
+         producer (text);
+         producer = nullptr;
+      }
+      return text;
+   }
+
+   bool
+   SelectionManager::setOwner (Atom selection,
+                               Time time, const ContentPtr& content)
    {
       Context& cx = ctx [selection];
 
       XSetSelectionOwner(dpy, selection, win, time);
       if (XGetSelectionOwner (dpy, selection) == win)
       {
-         cx.content = content_;
+         cx.content = content;
          cx.owned = true;
       }
       else
@@ -74,17 +146,6 @@ namespace zutty
       return cx.owned;
    }
 
-   bool
-   SelectionManager::copySelection (Atom dest, Atom source)
-   {
-      Context& cx = ctx [source];
-
-      if (! cx.owned)
-         return false;
-
-      return setSelection (dest, CurrentTime, cx.content);
-   }
-
    void
    SelectionManager::handleInboundIncr (Context& cx)
    {
@@ -132,27 +193,61 @@ namespace zutty
       XFlush (dpy);
    }
 
-   void
-   SelectionManager::handleOutboundIncr (Context& cx)
+   bool
+   SelectionManager::handleOutboundIncr (Transfer& tx)
    {
-      // Send next chunk of ongoing INCR transfer
-      size_t len = std::min (chunkSize, cx.content.length () - cx.cliPos);
+      // Send next chunk of ongoing INCR transfer, return true when done
+      // (or when the requestor has gone away)
+      const std::string& content = tx.content->get ();
+      size_t len = std::min (chunkSize, content.length () - tx.cliPos);
+
+      incrFailed = false;
+      incrDpy = dpy;
+      prevErrorHandler = XSetErrorHandler (incrErrorHandler);
       if (len > 0)
       {
          logT << "Sending next INCR chunk..." << std::endl;
-         XChangeProperty (dpy, cx.cliWin, cx.cliProp, target, 8, PropModeReplace,
-                          (const unsigned char *) cx.content.data () + cx.cliPos,
+         XChangeProperty (dpy, tx.cliWin, tx.cliProp, target, 8, PropModeReplace,
+                          (const unsigned char *) content.data () + tx.cliPos,
                           len);
       }
       else
       {
          logT << "Signaling end of INCR transfer..." << std::endl;
-         XChangeProperty (dpy, cx.cliWin, cx.cliProp, target, 8, PropModeReplace,
+         XChangeProperty (dpy, tx.cliWin, tx.cliProp, target, 8, PropModeReplace,
                           nullptr, 0);
-         cx.state = State::Idle;
       }
-      XFlush (dpy);
-      cx.cliPos += len;
+      XSync (dpy, False);
+      XSetErrorHandler (prevErrorHandler);
+      incrDpy = nullptr;
+
+      if (incrFailed)
+      {
+         logW << "Dropping INCR transfer to vanished requestor 0x"
+              << std::hex << tx.cliWin << std::dec << std::endl;
+         return true;
+      }
+      tx.cliPos += len;
+      tx.lastActive = Clock::now ();
+      return len == 0;
+   }
+
+   void
+   SelectionManager::dropStaleTransfers ()
+   {
+      const auto now = Clock::now ();
+      transfers.erase (std::remove_if (transfers.begin (), transfers.end (),
+                                       [&] (const Transfer& tx)
+                                       {
+                                          if (now - tx.lastActive < incrTimeout)
+                                             return false;
+                                          logW << "Dropping stalled INCR "
+                                               << "transfer to 0x" << std::hex
+                                               << tx.cliWin << std::dec
+                                               << std::endl;
+                                          return true;
+                                       }),
+                       transfers.end ());
    }
 
    void
@@ -168,16 +263,15 @@ namespace zutty
 
       if (event.state == PropertyDelete)
       {
-         if (cxp.state == State::WaitingForIncrAck &&
-             cxp.cliProp == event.atom)
-         {
-            handleOutboundIncr (cxp);
-         }
-         else if (cxc.state == State::WaitingForIncrAck &&
-                  cxc.cliProp == event.atom)
-         {
-            handleOutboundIncr (cxc);
-         }
+         dropStaleTransfers ();
+         auto it = std::find_if (transfers.begin (), transfers.end (),
+                                 [&] (const Transfer& tx)
+                                 {
+                                    return tx.cliWin == event.window &&
+                                           tx.cliProp == event.atom;
+                                 });
+         if (it != transfers.end () && handleOutboundIncr (*it))
+            transfers.erase (it);
       }
       else if (event.state == PropertyNewValue && event.atom == prop)
       {
@@ -201,8 +295,9 @@ namespace zutty
          return;
       }
 
+      // N.B.: ongoing transfers keep serving the content they started with
       ctx [event.selection].owned = false;
-      ctx [event.selection].content = "";
+      ctx [event.selection].content = nullptr;
    }
 
    void
@@ -290,13 +385,6 @@ namespace zutty
 
       Context& cx = ctx [event.selection];
 
-      if (cx.state != State::Idle)
-      {
-         logW << "Ignoring XSelectionRequestEvent in state=" << (int)cx.state
-              << std::endl;
-         return;
-      }
-
       if (! cx.owned)
       {
          logW << "Ignoring selection request for "
@@ -306,40 +394,50 @@ namespace zutty
          return;
       }
 
-      cx.cliWin = event.requestor;
-      cx.cliProp = event.property;
-      cx.cliPos = 0;
+      const Window cliWin = event.requestor;
+      const Atom cliProp = event.property;
 
       if (event.target == targets) // response to TARGETS request
       {
          Atom types [2] = { targets, target };
-         XChangeProperty (dpy, cx.cliWin, cx.cliProp, XA_ATOM, 32,
+         XChangeProperty (dpy, cliWin, cliProp, XA_ATOM, 32,
                           PropModeReplace, (const unsigned char *) types, 2);
       }
-      else if (chunkSize < cx.content.size ()) // INCR response
+      else if (chunkSize < cx.content->get ().size ()) // INCR response
       {
          logT << "Sending INCR response" << std::endl;
-         XChangeProperty (dpy, cx.cliWin, cx.cliProp, incr, 32,
+         XChangeProperty (dpy, cliWin, cliProp, incr, 32,
                           PropModeReplace, nullptr, 0);
-         XSelectInput (dpy, cx.cliWin, PropertyChangeMask);
-         cx.state = State::WaitingForIncrAck;
+         XSelectInput (dpy, cliWin, PropertyChangeMask);
+
+         // A new request to the same place supersedes an unfinished one
+         dropStaleTransfers ();
+         transfers.erase (std::remove_if (transfers.begin (), transfers.end (),
+                                          [&] (const Transfer& tx)
+                                          {
+                                             return tx.cliWin == cliWin &&
+                                                    tx.cliProp == cliProp;
+                                          }),
+                          transfers.end ());
+         transfers.push_back ({cliWin, cliProp, cx.content, Clock::now ()});
       }
       else // normal response (send all data)
       {
          logT << "Sending normal response" << std::endl;
-         XChangeProperty (dpy, cx.cliWin, cx.cliProp, target, 8,
+         const std::string& content = cx.content->get ();
+         XChangeProperty (dpy, cliWin, cliProp, target, 8,
                           PropModeReplace,
-                          (const unsigned char *) cx.content.data (),
-                          cx.content.size ());
+                          (const unsigned char *) content.data (),
+                          content.size ());
       }
 
       // send SelectionNotify event in response
       {
          XEvent res;
          res.xselection.type = SelectionNotify;
-         res.xselection.property = cx.cliProp;
+         res.xselection.property = cliProp;
          res.xselection.display = event.display;
-         res.xselection.requestor = cx.cliWin;
+         res.xselection.requestor = cliWin;
          res.xselection.selection = event.selection;
          res.xselection.target = event.target;
          res.xselection.time = event.time;
@@ -14,8 +14,10 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -33,6 +35,11 @@ namespace zutty
       using PasteCallbackFn = std::function <void (bool, const std::string&)>;
       void getSelection (Atom selection, Time, PasteCallbackFn&&);
       bool setSelection (Atom selection, const Time, const std::string&);
+
+      // Set selection content that is produced on demand, i.e., only when
+      // it is first requested (by us or another client), and at most once
+      using ContentFn = std::function <void (std::string&)>;
+      bool setSelection (Atom selection, const Time, ContentFn&&);
       bool copySelection (Atom dest, Atom source);
 
       void onPropertyNotify (XPropertyEvent& event);
@@ -56,30 +63,55 @@ namespace zutty
       enum class State: uint8_t
       {
          Idle,
-         WaitingForIncrAck,
          WaitingForSelNotify,
          ReadingIncr
       };
 
+      // Content of a selection we own, shared by selections holding the
+      // same content and by the outbound transfers serving it
+      class Content
+      {
+      public:
+         explicit Content (ContentFn&& producer_): producer (producer_) {}
+         const std::string& get ();
+
+      private:
+         ContentFn producer;
+         std::string text;
+      };
+      using ContentPtr = std::shared_ptr <Content>;
+
       struct Context
       {
          bool owned = false;
-         std::string content;
+         ContentPtr content;
          PasteCallbackFn pasteCallback;
          State state = State::Idle;
 
          // inbound transfer state
          std::vector <unsigned char> incoming;
+      };
+      std::unordered_map <Atom, Context> ctx;
 
-         // outbound transfer state
-         size_t cliPos;
+      // Outbound INCR transfer state, one for each requestor (identified
+      // by its window and property), so that several can run at once.
+      // A requestor that stops asking for chunks (e.g. because it went
+      // away) has its transfer dropped after a while.
+      using Clock = std::chrono::steady_clock;
+      struct Transfer
+      {
          Window cliWin;
          Atom cliProp;
+         ContentPtr content;
+         Clock::time_point lastActive;
+         size_t cliPos = 0;
       };
-      std::unordered_map <Atom, Context> ctx;
+      std::vector <Transfer> transfers;
 
+      bool setOwner (Atom selection, const Time, const ContentPtr&);
       void handleInboundIncr (Context& cx);
-      void handleOutboundIncr (Context& cx);
+      bool handleOutboundIncr (Transfer& tx);
+      void dropStaleTransfers ();
    };
 
 } // namespace zutty
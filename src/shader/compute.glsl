@@ -11,7 +11,12 @@
 
 #version 310 es
 
-layout (local_size_x = 1, local_size_y = 1) in;
+// Each workgroup renders a tile of cells: first, each invocation loads and
+// decodes one cell into shared memory, then the pixels of the tile are
+// rendered, one pixel per invocation at a time.
+#define TILE_COLS 32
+#define TILE_ROWS 2
+layout (local_size_x = TILE_COLS, local_size_y = TILE_ROWS) in;
 layout (rgba8, binding = 0) writeonly lowp uniform image2D imgOut;
 layout (binding = 1) uniform lowp sampler2DArray atlas;
 layout (binding = 2) uniform lowp sampler2D atlasMap;
@@ -29,6 +34,9 @@ uniform highp ivec2 selectDamage;
 uniform lowp int deltaFrame;
 uniform lowp int showWraps;
 uniform lowp int hasDoubleWidth;
+uniform highp int rowOffset; // rotation of rows in imgOut
+uniform lowp int synthStyles; // synthesize bold & italic from layer 0
+uniform lowp int italicPivot; // glyph row not slanted by synthetic italic
 
 struct Cell
 {
@@ -42,6 +50,12 @@ layout (std430, binding = 0) buffer CharVideoMem
    Cell cells [];
 } vmem;
 
+// In a delta frame, the tiles to draw (one per workgroup) as (y << 16 | x)
+layout (std430, binding = 1) readonly buffer TileList
+{
+   highp uint tiles [];
+} tileList;
+
 vec3 colorFromRGBu8 (in highp uint v)
 {
    return vec3 (float (bitfieldExtract (v, 0, 8)),
@@ -72,9 +86,32 @@ vec3 underlinedBg (in bool underline, in vec2 ulMetrics, in int y,
    return mix (bg, fg, lumi);
 }
 
-void main ()
+// Bits of TileCell.flags
+#define CF_DRAW       1u  // cell to be drawn
+#define CF_DWIDTH     2u  // double-width (also drawn over the next cell)
+#define CF_UNDERLINE  4u
+#define CF_WRAP       8u  // draw wrap mark
+#define CF_CURSOR    16u  // draw non-block cursor
+#define CF_FONT_SHIFT 5   // 2 bits of font index
+
+struct TileCell
+{
+   uint flags;
+   ivec2 src; // glyph position in atlas
+   vec3 fg;
+   vec3 bg;
+   vec3 cr;
+};
+
+shared TileCell tile [TILE_ROWS][TILE_COLS];
+
+TileCell loadCell (in ivec2 charPos)
 {
-   ivec2 charPos = ivec2 (gl_GlobalInvocationID.xy);
+   TileCell tc;
+   tc.flags = 0u;
+   if (charPos.x >= sizeChars.x || charPos.y >= sizeChars.y)
+      return tc;
+
    int idx = sizeChars.x * charPos.y + charPos.x;
    Cell cell = vmem.cells [idx];
 
@@ -84,7 +121,7 @@ void main ()
       if (dirty == 0u &&
           charPos != cursorPos.xy && charPos != cursorPos.zw &&
           (idx < selectDamage.x || idx >= selectDamage.y))
-         return;
+         return tc;
    }
    vmem.cells [idx].charData = bitfieldInsert (cell.charData, 0u, 23, 1);
 
@@ -95,7 +132,7 @@ void main ()
    uint dwidth = bitfieldExtract (cell.charData, 16, 1);
    uint dwidth_cont = bitfieldExtract (cell.charData, 17, 1);
    if (dwidth_cont == 1u) // double-width cell continuation - drawn by left half
-      return;
+      return tc;
 
    if (dwidth == 1u && charPos.x < sizeChars.x - 1)
    {
@@ -150,101 +187,160 @@ void main ()
       bgColor = crColor;
    }
 
-   ivec2 cellSize = glyphSize;
+   tc.flags = CF_DRAW | (fontIdx << CF_FONT_SHIFT);
    if (dwidth == 1u)
-      cellSize = ivec2 (2, 1) * glyphSize;
-
-   ivec2 src = atlasPos * cellSize;
-   ivec2 dst = charPos * glyphSize;
+      tc.flags |= CF_DWIDTH;
+   if (underline == 1u)
+      tc.flags |= CF_UNDERLINE;
+   if (showWraps == 1 && wrap == 1u)
+      tc.flags |= CF_WRAP;
+   if (charPos == cursorPos.xy && cursorStyle > 1)
+      tc.flags |= CF_CURSOR;
+   tc.src = atlasPos * ivec2 (dwidth + 1u, 1) * glyphSize;
+   tc.fg = fgColor;
+   tc.bg = bgColor;
+   tc.cr = crColor;
+   return tc;
+}
 
-   if (dwidth == 0u)
-   {  // render regular cell
-      for (int k = 0; k < cellSize.y; k++)
+// Glyph intensity at (j, k) in the style fontIdx, synthesized from the
+// regular glyph: italic slants it by about 12 degrees (shifting rows by
+// 27/128 pixel per row from italicPivot, the middle row), bold widens its
+// strokes by one pixel to the right. N.B.: SoftCharVdev does exactly the
+// same.
+float synthGlyph (in ivec2 src, in int j, in int k, in uint fontIdx)
+{
+   if ((fontIdx & 2u) != 0u)
+   {
+      // Shift the row no further than its blank margin on that side (less
+      // the widening, if bold), so that no ink is pushed out of the cell
+      int shift = ((italicPivot - k) * 27 + 64) >> 7;
+      int bold = int (fontIdx & 1u);
+      int room = 0;
+      if (shift > 0)
       {
-         vec3 ulBg = underlinedBg (underline == 1u, ulMetrics [fontIdx],
-                                   k, bgColor, fgColor);
-         for (int j = 0; j < cellSize.x; j++)
-         {
-            ivec3 txc = ivec3 (src + ivec2 (j, k), fontIdx);
-            float lumi = texelFetch (atlas, txc, 0).r;
-            vec4 pixel = vec4 (mix (ulBg, fgColor, lumi), 1.0);
-            imageStore (imgOut, dst + ivec2 (j, k), pixel);
-         }
+         while (room < shift + bold && room < glyphSize.x &&
+                texelFetch (atlas, ivec3 (src + ivec2 (glyphSize.x - 1 - room,
+                                                       k), 0), 0).r == 0.0)
+            ++room;
+         shift = max (0, min (shift, room - bold));
       }
-   }
-   else if (hasDoubleWidth == 1)
-   {  // render double-width cell
-      for (int k = 0; k < cellSize.y; k++)
+      else
       {
-         vec3 ulBg = underlinedBg (underline == 1u, ulMetrics [fontIdx],
-                                   k, bgColor, fgColor);
-         for (int j = 0; j < cellSize.x; j++)
-         {
-            ivec3 txc = ivec3 (src + ivec2 (j, k), fontIdx);
-            float lumi = texelFetch (atlas_dw, txc, 0).r;
-            vec4 pixel = vec4 (mix (ulBg, fgColor, lumi), 1.0);
-            imageStore (imgOut, dst + ivec2 (j, k), pixel);
-         }
+         while (room < -shift && room < glyphSize.x &&
+                texelFetch (atlas, ivec3 (src + ivec2 (room, k), 0), 0).r
+                == 0.0)
+            ++room;
+         shift = -room;
       }
+      j -= shift;
+   }
+
+   float lumi = 0.0;
+   if (j >= 0 && j < glyphSize.x)
+      lumi = texelFetch (atlas, ivec3 (src + ivec2 (j, k), 0), 0).r;
+   if ((fontIdx & 1u) != 0u && j >= 1 && j <= glyphSize.x)
+      lumi = max (lumi,
+                  texelFetch (atlas, ivec3 (src + ivec2 (j - 1, k), 0), 0).r);
+   return lumi;
+}
+
+vec3 renderPixel (in TileCell tc, in int j, in int k)
+{
+   ivec2 cellSize = glyphSize;
+   if ((tc.flags & CF_DWIDTH) != 0u)
+      cellSize = ivec2 (2, 1) * glyphSize;
+
+   if ((tc.flags & CF_CURSOR) != 0u)
+   {
+      if ((cursorStyle == 2 && (j == 0 || j == cellSize.x - 1 ||
+                                k == 0 || k == cellSize.y - 1)) ||
+          (cursorStyle == 3 && k >= cellSize.y - 2) ||
+          (cursorStyle == 4 && j < 2))
+         return tc.cr;
+   }
+
+   if ((tc.flags & CF_WRAP) != 0u && j == cellSize.x - 1 && k % 2 == 0)
+      return tc.fg;
+
+   uint fontIdx = bitfieldExtract (tc.flags, CF_FONT_SHIFT, 2);
+   vec3 ulBg = underlinedBg ((tc.flags & CF_UNDERLINE) != 0u,
+                             ulMetrics [fontIdx], k, tc.bg, tc.fg);
+   ivec3 txc = ivec3 (tc.src + ivec2 (j, k), fontIdx);
+
+   if ((tc.flags & CF_DWIDTH) == 0u)
+   {  // regular cell
+      if (synthStyles == 1 && fontIdx != 0u)
+         return mix (ulBg, tc.fg, synthGlyph (tc.src, j, k, fontIdx));
+      return mix (ulBg, tc.fg, texelFetch (atlas, txc, 0).r);
+   }
+   else if (hasDoubleWidth == 1)
+   {  // double-width cell
+      return mix (ulBg, tc.fg, texelFetch (atlas_dw, txc, 0).r);
    }
    else
    {  // no double-width font -- draw an empty box
-      for (int k = 0; k < cellSize.y; k++)
-      {
-         for (int j = 0; j < cellSize.x; j++)
-         {
-            float lumi = 0.0;
-            if ((0 < j && j < cellSize.x - 1) &&
-                (0 < k && k < cellSize.y - 1) &&
-                (j == 1 || j == cellSize.x - 2 ||
-                 k == 1 || k == cellSize.y - 2))
-               lumi = 0.7;
-            vec4 pixel = vec4 (mix (bgColor, fgColor, lumi), 1.0);
-            imageStore (imgOut, dst + ivec2 (j, k), pixel);
-         }
-      }
+      float lumi = 0.0;
+      if ((0 < j && j < cellSize.x - 1) &&
+          (0 < k && k < cellSize.y - 1) &&
+          (j == 1 || j == cellSize.x - 2 ||
+           k == 1 || k == cellSize.y - 2))
+         lumi = 0.7;
+      return mix (tc.bg, tc.fg, lumi);
    }
+}
 
-   if (showWraps == 1 && wrap == 1u)
+void main ()
+{
+   ivec2 tileId = ivec2 (gl_LocalInvocationID.xy);
+   ivec2 tilePos = ivec2 (gl_WorkGroupID.xy);
+   if (deltaFrame == 1)
    {
-      vec4 pixel = vec4 (fgColor, 1.0);
-      for (int k = 0; k < cellSize.y; k += 2)
-      {
-         imageStore (imgOut, dst + ivec2 (cellSize.x - 1, k), pixel);
-      }
+      highp uint tile = tileList.tiles [gl_WorkGroupID.x];
+      tilePos = ivec2 (bitfieldExtract (tile, 0, 16),
+                       bitfieldExtract (tile, 16, 16));
    }
+   ivec2 tileOrigin = tilePos * ivec2 (TILE_COLS, TILE_ROWS);
+
+   tile [tileId.y][tileId.x] = loadCell (tileOrigin + tileId);
+   memoryBarrierShared ();
+   barrier ();
 
-   if (charPos == cursorPos.xy)
+   // The right half of a double-width cell is drawn as part of the column
+   // after it (which might be beyond the last column of the tile)
+   ivec2 tilePixels = glyphSize * ivec2 (TILE_COLS + 1, TILE_ROWS);
+   ivec2 viewPixels = glyphSize * sizeChars;
+   ivec2 dst0 = tileOrigin * glyphSize;
+
+   for (int y = tileId.y; y < tilePixels.y; y += TILE_ROWS)
    {
-      vec4 pixel = vec4 (crColor, 1.0);
-      if (cursorStyle == 2)
-      {
-         for (int j = 0; j < cellSize.x; j++)
-         {
-            imageStore (imgOut, dst + ivec2 (j, 0), pixel);
-            imageStore (imgOut, dst + ivec2 (j, cellSize.y - 1), pixel);
-         }
-         for (int k = 1; k < cellSize.y - 1; k++)
-         {
-            imageStore (imgOut, dst + ivec2 (0, k), pixel);
-            imageStore (imgOut, dst + ivec2 (cellSize.x - 1, k), pixel);
-         }
-      }
-      else if (cursorStyle == 3)
-      {
-         for (int j = 0; j < cellSize.x; j++)
-         {
-            imageStore (imgOut, dst + ivec2 (j, cellSize.y - 2), pixel);
-            imageStore (imgOut, dst + ivec2 (j, cellSize.y - 1), pixel);
-         }
-      }
-      else if (cursorStyle == 4)
+      int row = y / glyphSize.y;
+      int k = y - row * glyphSize.y;
+      if (dst0.y + y >= viewPixels.y)
+         break;
+
+      for (int x = tileId.x; x < tilePixels.x; x += TILE_COLS)
       {
-         for (int k = 0; k < cellSize.y; k++)
+         if (dst0.x + x >= viewPixels.x)
+            break;
+
+         int col = x / glyphSize.x;
+         int j = x - col * glyphSize.x;
+         TileCell tc;
+         if (col < TILE_COLS && (tile [row][col].flags & CF_DRAW) != 0u)
+            tc = tile [row][col];
+         else if (col > 0 && (tile [row][col - 1].flags & CF_DWIDTH) != 0u)
          {
-            imageStore (imgOut, dst + ivec2 (0, k), pixel);
-            imageStore (imgOut, dst + ivec2 (1, k), pixel);
+            tc = tile [row][col - 1];
+            j += glyphSize.x;
          }
+         else
+            continue;
+
+         ivec2 dst = dst0 + ivec2 (x, y);
+         dst.y = ((tileOrigin.y + row + rowOffset) % sizeChars.y) *
+                 glyphSize.y + k;
+         imageStore (imgOut, dst, vec4 (renderPixel (tc, j, k), 1.0));
       }
    }
 }
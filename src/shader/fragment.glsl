@@ -16,10 +16,13 @@ in highp vec2 texCoord;
 layout (rgba8, binding = 0) readonly lowp uniform image2D imgOut;
 
 uniform highp vec2 viewPixels;
+uniform highp int rowShift; // rotation of rows in imgOut, in pixels
 
 layout (location = 0) out lowp vec4 outColor;
 
 void main ()
 {
-   outColor = imageLoad (imgOut, ivec2 (texCoord * viewPixels));
+   ivec2 pos = ivec2 (texCoord * viewPixels);
+   pos.y = (pos.y + rowShift) % int (viewPixels.y);
+   outColor = imageLoad (imgOut, pos);
 }
@@ -0,0 +1,807 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "log.h"
+#include "options.h"
+#include "softvdev.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+   // Frames with fewer cells to draw are not worth waking up the workers
+   constexpr const int minParallelCells = 1024;
+   constexpr const unsigned maxThreads = 8;
+
+   // x / 255, rounded to nearest, for x in [0, 255 * 255]
+   inline uint32_t
+   div255 (uint32_t x)
+   {
+      x += 128;
+      return (x + (x >> 8)) >> 8;
+   }
+
+   // Mix two pixels channel-wise: alpha = 0 yields bg, alpha = 255 fg
+   inline uint32_t
+   blend (uint32_t bg, uint32_t fg, uint32_t alpha)
+   {
+      uint32_t out = 0;
+      for (int sh = 0; sh < 32; sh += 8)
+      {
+         const uint32_t b = (bg >> sh) & 0xff;
+         const uint32_t f = (fg >> sh) & 0xff;
+         out |= div255 (b * (255 - alpha) + f * alpha) << sh;
+      }
+      return out;
+   }
+
+   // Blend n pixels of a glyph row: dst [j] = blend (bg, fg, alpha [j])
+   void
+   blendRow (uint32_t* dst, const uint8_t* alpha, int n,
+             uint32_t bg, uint32_t fg)
+   {
+      int j = 0;
+   #if defined (__SSE2__)
+      // Four pixels at a time, with channels widened to 16 bits; all the
+      // intermediate values fit, so the result is the same as blend ().
+      const __m128i zero = _mm_setzero_si128 ();
+      const __m128i c128 = _mm_set1_epi16 (128);
+      const __m128i c255 = _mm_set1_epi16 (255);
+      const __m128i bg16 = _mm_unpacklo_epi8 (_mm_set1_epi32 (bg), zero);
+      const __m128i fg16 = _mm_unpacklo_epi8 (_mm_set1_epi32 (fg), zero);
+      const __m128i bg32 = _mm_set1_epi32 (bg);
+
+      // Blend two pixels, given their alpha in all four channels
+      auto blend2 =
+         [&] (__m128i a16)
+         {
+            __m128i x = _mm_add_epi16 (
+               _mm_mullo_epi16 (bg16, _mm_sub_epi16 (c255, a16)),
+               _mm_mullo_epi16 (fg16, a16));
+            x = _mm_add_epi16 (x, c128);
+            return _mm_srli_epi16 (_mm_add_epi16 (x, _mm_srli_epi16 (x, 8)),
+                                   8);
+         };
+
+      for (; j + 4 <= n; j += 4)
+      {
+         int32_t a4;
+         memcpy (&a4, alpha + j, sizeof (a4));
+         __m128i* out = reinterpret_cast <__m128i*> (dst + j);
+         if (a4 == 0) // blank, as most of a glyph cell is
+         {
+            _mm_storeu_si128 (out, bg32);
+            continue;
+         }
+         __m128i a = _mm_cvtsi32_si128 (a4);
+         a = _mm_unpacklo_epi8 (a, a);
+         a = _mm_unpacklo_epi16 (a, a); // each alpha byte repeated 4 times
+         const __m128i lo = blend2 (_mm_unpacklo_epi8 (a, zero));
+         const __m128i hi = blend2 (_mm_unpackhi_epi8 (a, zero));
+         _mm_storeu_si128 (out, _mm_packus_epi16 (lo, hi));
+      }
+   #endif
+      for (; j < n; ++j)
+         dst [j] = blend (bg, fg, alpha [j]);
+   }
+
+   // Intensity of the underline in each glyph row, as in the shader
+   void
+   makeUlLumi (float ulTop, float ulThick, int py, std::vector <uint8_t>& lumi)
+   {
+      auto fract = [] (float v) { return v - std::floor (v); };
+
+      lumi.assign (py, 0);
+      const int yStart = (int) std::floor (ulTop);
+      const int yEnd = (int) std::ceil (ulTop + ulThick);
+      for (int y = std::max (0, yStart); y <= yEnd && y < py; ++y)
+      {
+         float l = 1.0;
+         if (y == yEnd)
+            l = fract (ulTop + ulThick);
+         if (y == yStart)
+            l = l - fract (ulTop);
+         lumi [y] = (uint8_t) std::lround (255 * std::max (0.0f, l));
+      }
+   }
+
+   /* Row k of the glyph in style fontIdx, synthesized from the row src of
+    * the regular glyph (of width px) exactly like the shader does it (see
+    * synthGlyph () in compute.glsl).
+    */
+   void
+   synthRow (uint8_t* alpha, const uint8_t* src, int n, int px, int k,
+             int fontIdx, int italicPivot)
+   {
+      int shift = 0;
+      if (fontIdx & 2)
+      {
+         // Shift the row no further than its blank margin on that side
+         // (less the widening, if bold), so that no ink leaves the cell
+         shift = ((italicPivot - k) * 27 + 64) >> 7;
+         const int bold = fontIdx & 1;
+         int room = 0;
+         if (shift > 0)
+         {
+            while (room < shift + bold && room < px && !src [px - 1 - room])
+               ++room;
+            shift = std::max (0, std::min (shift, room - bold));
+         }
+         else
+         {
+            while (room < -shift && room < px && !src [room])
+               ++room;
+            shift = -room;
+         }
+      }
+      for (int j = 0; j < n; ++j)
+      {
+         const int sj = j - shift;
+         uint8_t a = (sj >= 0 && sj < px) ? src [sj] : 0;
+         if ((fontIdx & 1) && sj >= 1 && sj <= px)
+            a = std::max (a, src [sj - 1]);
+         alpha [j] = a;
+      }
+   }
+
+   /* X errors are handled by a process-wide handler, which would exit on
+    * a failing XShmAttach (e.g. if the X server is in a different IPC
+    * namespace). While attaching, errors on the display doing so are only
+    * noted instead; others are passed on to the original handler.
+    */
+   std::atomic <Display*> shmAttachDpy {nullptr};
+   std::atomic <bool> shmAttachFailed {false};
+   XErrorHandler prevErrorHandler = nullptr;
+
+   int
+   shmAttachErrorHandler (Display* dpy, XErrorEvent* ev)
+   {
+      if (dpy == shmAttachDpy)
+      {
+         shmAttachFailed = true;
+         return 0;
+      }
+      return prevErrorHandler ? prevErrorHandler (dpy, ev) : 0;
+   }
+
+   bool
+   shmAttach (Display* dpy, XShmSegmentInfo* shmInfo)
+   {
+      shmAttachFailed = false;
+      shmAttachDpy = dpy;
+      prevErrorHandler = XSetErrorHandler (shmAttachErrorHandler);
+      XShmAttach (dpy, shmInfo);
+      XSync (dpy, False);
+      XSetErrorHandler (prevErrorHandler);
+      shmAttachDpy = nullptr;
+      return !shmAttachFailed;
+   }
+
+   int
+   maskShift (unsigned long mask)
+   {
+      if (!mask)
+         return -1;
+      const int shift = __builtin_ctzl (mask);
+      if (shift % 8 || mask != 0xffUL << shift)
+         return -1;
+      return shift;
+   }
+
+} // namespace
+
+namespace zutty
+{
+   /* Presentation of the frame buffer in an X window. This uses its own
+    * connection to the display, so as to be independent of the main
+    * thread (handling events of the window on the main connection).
+    */
+   struct SoftCharVdev::Presenter
+   {
+      explicit Presenter (Window window);
+      ~Presenter ();
+
+      uint32_t* allocate (int width, int height, int& stride);
+      void put (int y, int height, int width);
+      void sync () { XSync (dpy, False); };
+
+      Display* dpy = nullptr;
+      Window win;
+      GC gc;
+      Visual* visual;
+      int depth;
+      int rShift, gShift, bShift;
+      bool useShm = false;
+      XShmSegmentInfo shmInfo;
+      XImage* image = nullptr;
+
+      void release ();
+   };
+
+   SoftCharVdev::Presenter::Presenter (Window window)
+      : win (window)
+   {
+      dpy = XOpenDisplay (opts.display);
+      if (!dpy)
+         throw std::runtime_error ("SoftCharVdev: couldn't open display");
+
+      XWindowAttributes wa;
+      XGetWindowAttributes (dpy, win, &wa);
+      visual = wa.visual;
+      depth = wa.depth;
+      rShift = maskShift (visual->red_mask);
+      gShift = maskShift (visual->green_mask);
+      bShift = maskShift (visual->blue_mask);
+      if (visual->c_class != TrueColor ||
+          rShift < 0 || gShift < 0 || bShift < 0)
+         throw std::runtime_error ("SoftCharVdev: unsupported visual");
+
+      gc = XCreateGC (dpy, win, 0, nullptr);
+
+      // Shared memory only works with a local display; a display that
+      // is e.g. forwarded via ssh might still claim to support it.
+      const char* name = DisplayString (dpy);
+      useShm = XShmQueryExtension (dpy) &&
+               (name [0] == ':' || strncmp (name, "unix:", 5) == 0);
+      logI << "SoftCharVdev: presenting via "
+           << (useShm ? "MIT-SHM" : "XPutImage") << std::endl;
+   }
+
+   SoftCharVdev::Presenter::~Presenter ()
+   {
+      release ();
+      XFreeGC (dpy, gc);
+      XCloseDisplay (dpy);
+   }
+
+   uint32_t*
+   SoftCharVdev::Presenter::allocate (int width, int height, int& stride)
+   {
+      release ();
+
+      if (useShm)
+      {
+         image = XShmCreateImage (dpy, visual, depth, ZPixmap, nullptr,
+                                  &shmInfo, width, height);
+         shmInfo.shmid = -1;
+         if (image)
+            shmInfo.shmid = shmget (IPC_PRIVATE,
+                                    image->bytes_per_line * image->height,
+                                    IPC_CREAT | 0600);
+         bool attached = false;
+         if (shmInfo.shmid >= 0)
+         {
+            void* addr = shmat (shmInfo.shmid, nullptr, 0);
+            if (addr != (void*) -1)
+            {
+               shmInfo.shmaddr = image->data = (char*) addr;
+               shmInfo.readOnly = False;
+               attached = shmAttach (dpy, &shmInfo);
+               if (!attached)
+                  shmdt (addr);
+            }
+            // Mark for removal, to be done once detached by all parties
+            shmctl (shmInfo.shmid, IPC_RMID, nullptr);
+         }
+         if (!attached)
+         {
+            logW << "SoftCharVdev: couldn't set up shared memory, "
+                 << "falling back to XPutImage" << std::endl;
+            if (image)
+            {
+               image->data = nullptr; // not to be freed by Xlib
+               XDestroyImage (image);
+            }
+            image = nullptr;
+            useShm = false;
+         }
+      }
+
+      if (!useShm)
+      {
+         char* data = (char*) malloc (4 * width * height);
+         if (!data)
+            throw std::runtime_error ("SoftCharVdev: out of memory");
+         image = XCreateImage (dpy, visual, depth, ZPixmap, 0, data,
+                               width, height, 32, 0);
+         if (!image)
+         {
+            free (data);
+            throw std::runtime_error ("SoftCharVdev: XCreateImage failed");
+         }
+         // The frame buffer is in host byte order; Xlib converts if needed
+         const uint32_t one = 1;
+         image->byte_order =
+            * (const uint8_t*) &one ? LSBFirst : MSBFirst;
+      }
+
+      if (image->bits_per_pixel != 32)
+         throw std::runtime_error ("SoftCharVdev: unsupported pixel format");
+
+      stride = image->bytes_per_line / 4;
+      return (uint32_t*) image->data;
+   }
+
+   void
+   SoftCharVdev::Presenter::put (int y, int height, int width)
+   {
+      if (useShm)
+         XShmPutImage (dpy, win, gc, image, 0, y, 0, y, width, height, False);
+      else
+         XPutImage (dpy, win, gc, image, 0, y, 0, y, width, height);
+   }
+
+   void
+   SoftCharVdev::Presenter::release ()
+   {
+      if (!image)
+         return;
+
+      if (useShm)
+      {
+         XShmDetach (dpy, &shmInfo);
+         XSync (dpy, False);
+         XDestroyImage (image);
+         shmdt (shmInfo.shmaddr);
+      }
+      else
+      {
+         XDestroyImage (image); // frees the data as well
+      }
+      image = nullptr;
+   }
+
+   SoftCharVdev::SoftCharVdev (Fontpack* fontpk, unsigned long window)
+      : CharVdev (fontpk)
+   {
+      const float* ulMetrics = fontpk->getUlMetrics ();
+      for (int k = 0; k < 4; ++k)
+      {
+         // With synthesized styles, all of them use the regular glyphs
+         layer [k].data =
+            atlas->getLayerData (std::min (k, atlas->getNumLayers () - 1));
+         layer [k].stride = atlas->getStride ();
+         makeUlLumi (ulMetrics [2 * k], ulMetrics [2 * k + 1], py,
+                     layer [k].ulLumi);
+      }
+
+      if (atlas_dw)
+      {
+         hasDoubleWidth = true;
+         layer_dw.data = atlas_dw->getLayerData (0);
+         layer_dw.stride = atlas_dw->getStride ();
+         layer_dw.ulLumi = layer [0].ulLumi;
+      }
+
+      if (window)
+      {
+         presenter = std::make_unique <Presenter> (window);
+         rShift = presenter->rShift;
+         gShift = presenter->gShift;
+         bShift = presenter->bShift;
+      }
+
+      const unsigned nThreads =
+         std::max (1u, std::min (maxThreads,
+                                 std::thread::hardware_concurrency ()));
+      for (unsigned k = 1; k < nThreads; ++k)
+         workers.emplace_back (&SoftCharVdev::workerThread, this);
+      alphaBuf.resize (nThreads * 2 * px); // as nBands <= nThreads
+      logI << "Software rendering with " << nThreads << " thread(s)"
+           << std::endl;
+   }
+
+   SoftCharVdev::~SoftCharVdev ()
+   {
+      {
+         std::lock_guard <std::mutex> lk (workMx);
+         workDone = true;
+      }
+      workCond.notify_all ();
+      for (auto& thr: workers)
+         thr.join ();
+   }
+
+   bool
+   SoftCharVdev::resize (uint16_t pxWidth_, uint16_t pxHeight_)
+   {
+      assert (cells == nullptr); // no mapping in place
+
+      if (pxWidth == pxWidth_ && pxHeight == pxHeight_)
+         return false;
+
+      pxWidth = pxWidth_;
+      pxHeight = pxHeight_;
+      nCols = std::max (1, (pxWidth - 2 * opts.border) / px);
+      nRows = std::max (1, (pxHeight - 2 * opts.border) / py);
+
+      logI << "Resize to " << pxWidth << " x " << pxHeight
+           << " pixels, " << nCols << " x " << nRows << " chars"
+           << std::endl;
+
+      // As with GLCharVdev, the frame buffer is only reallocated (with
+      // some headroom) when growing beyond its current capacity.
+      if (pxWidth > capacity.x || pxHeight > capacity.y)
+      {
+         capacity.x = grow (capacity.x, pxWidth, USHRT_MAX);
+         capacity.y = grow (capacity.y, pxHeight, USHRT_MAX);
+         logT << "Frame buffer capacity: " << capacity.x << " x "
+              << capacity.y << " pixels" << std::endl;
+
+         if (presenter)
+         {
+            pixels = presenter->allocate (capacity.x, capacity.y, stride);
+         }
+         else
+         {
+            stride = capacity.x;
+            pixelBuf.assign (stride * capacity.y, 0);
+            pixels = pixelBuf.data ();
+         }
+      }
+
+      cellBuf.resize (nCols * nRows);
+      return true;
+   }
+
+   void
+   SoftCharVdev::setCursor (const Cursor& cursor_)
+   {
+      prevCursorPos = Point (cursor.posX, cursor.posY);
+      cursor = cursor_;
+   }
+
+   void
+   SoftCharVdev::setSelection (const Rect& sel)
+   {
+      Rect changed (std::min (sel.tl, selection.tl),
+                    std::max (sel.br, selection.br));
+      selectDamageStart = nCols * changed.tl.y + changed.tl.x;
+      selectDamageEnd = nCols * changed.br.y + changed.br.x + 1;
+      selection = sel;
+   }
+
+   void
+   SoftCharVdev::setDeltaFrame (bool delta)
+   {
+      deltaFrame = delta;
+   }
+
+   void
+   SoftCharVdev::draw ()
+   {
+      assert (cells == nullptr); // no mapping in place
+
+      if (!deltaFrame)
+      {
+         // Clear the whole buffer, incl. the border and any fractional
+         // cells at the right and bottom edges
+         const uint32_t bg = pack (opts.bg);
+         for (int y = 0; y < pxHeight; ++y)
+            std::fill_n (pixels + y * stride, pxWidth, bg);
+      }
+
+      int nCells = 0;
+      drawRows.clear ();
+      for (uint16_t y = 0; y < nRows; ++y)
+      {
+         int n = 0;
+         for (uint16_t x = 0; x < nCols; ++x)
+            n += isCellDamaged (x, y);
+         if (n)
+            drawRows.push_back (y);
+         nCells += n;
+      }
+
+      // Glyphs are loaded into the atlases before the drawing starts, as
+      // the atlases are not to be changed while the workers draw from them
+      atlas->beginFrame ();
+      if (atlas_dw)
+         atlas_dw->beginFrame ();
+      for (uint16_t y: drawRows)
+         for (uint16_t x = 0; x < nCols; ++x)
+            if (isCellDamaged (x, y))
+               loadGlyph (cellBuf.data () + nCols * y, x);
+      atlas->discardChanges ();
+      if (atlas_dw)
+         atlas_dw->discardChanges ();
+
+      if (workers.empty () || nCells < minParallelCells)
+      {
+         for (uint16_t y: drawRows)
+            drawRow (y, alphaBuf.data ());
+      }
+      else
+      {
+         std::unique_lock <std::mutex> lk (workMx);
+         nBands = std::min (drawRows.size (), workers.size () + 1);
+         nextBand = 0;
+         bandsDone = 0;
+         ++workSeq;
+         workCond.notify_all ();
+         drawBands (lk);
+         doneCond.wait (lk, [this] () { return bandsDone == nBands; });
+      }
+
+      // Damage: runs of consecutive drawn rows (or everything)
+      damage.clear ();
+      const int yLimit = std::min ((int)pxHeight, opts.border + nRows * py);
+      if (!deltaFrame)
+      {
+         damage.emplace_back (0, 0, pxWidth, pxHeight);
+      }
+      else for (size_t k = 0; k < drawRows.size (); )
+      {
+         size_t end = k + 1;
+         while (end < drawRows.size () &&
+                drawRows [end] == drawRows [end - 1] + 1)
+            ++end;
+         const int y0 = opts.border + drawRows [k] * py;
+         const int y1 = std::min (yLimit,
+                                  opts.border + (drawRows [end - 1] + 1) * py);
+         if (y0 < y1)
+            damage.emplace_back (0, y0, pxWidth, y1);
+         k = end;
+      }
+
+      if (!presenter)
+         return;
+
+      for (const Rect& r: damage)
+         presenter->put (r.tl.y, r.br.y - r.tl.y, pxWidth);
+      presenter->sync (); // the buffer is not to be touched until done
+   }
+
+   // private methods
+
+   CharVdev::Cell *
+   SoftCharVdev::mapCells ()
+   {
+      return cellBuf.data ();
+   }
+
+   void
+   SoftCharVdev::unmapCells ()
+   {
+   }
+
+   uint32_t
+   SoftCharVdev::pack (const Color& c) const
+   {
+      return c.red << rShift | c.green << gShift | c.blue << bShift;
+   }
+
+   bool
+   SoftCharVdev::isCellDamaged (uint16_t x, uint16_t y) const
+   {
+      if (!deltaFrame)
+         return true;
+
+      const int idx = nCols * y + x;
+      return cellBuf [idx].dirty ||
+             (x == cursor.posX && y == cursor.posY) ||
+             (x == prevCursorPos.x && y == prevCursorPos.y) ||
+             (idx >= selectDamageStart && idx < selectDamageEnd);
+   }
+
+   bool
+   SoftCharVdev::isSelected (uint16_t x, uint16_t y) const
+   {
+      const Rect& sel = selection;
+      if (sel.rectangular)
+         return y >= sel.tl.y && y <= sel.br.y &&
+                x >= sel.tl.x && x < sel.br.x;
+
+      return (y > sel.tl.y && y < sel.br.y) ||
+             (y == sel.tl.y && x >= sel.tl.x &&
+              (y < sel.br.y || x < sel.br.x)) ||
+             (y == sel.br.y && x < sel.br.x &&
+              (y > sel.tl.y || x > sel.tl.x));
+   }
+
+   void
+   SoftCharVdev::drawBands (std::unique_lock <std::mutex>& lk)
+   {
+      const int n = drawRows.size ();
+      while (nextBand < nBands)
+      {
+         const int band = nextBand++;
+         uint8_t* alpha = alphaBuf.data () + band * 2 * px;
+         lk.unlock ();
+         for (int k = band * n / nBands; k < (band + 1) * n / nBands; ++k)
+            drawRow (drawRows [k], alpha);
+         lk.lock ();
+         if (++bandsDone == nBands)
+            doneCond.notify_one ();
+      }
+   }
+
+   void
+   SoftCharVdev::drawRow (uint16_t y, uint8_t* alpha)
+   {
+      for (uint16_t x = 0; x < nCols; ++x)
+         if (isCellDamaged (x, y))
+            drawCell (x, y, alpha);
+   }
+
+   /* Render a cell, exactly like the compute shader of GLCharVdev does
+    * (alpha is scratch space for a synthesized glyph row, see alphaBuf).
+    */
+   void
+   SoftCharVdev::drawCell (uint16_t x, uint16_t y, uint8_t* alpha)
+   {
+      const int idx = nCols * y + x;
+      Cell& cell = cellBuf [idx];
+      cell.dirty = 0;
+
+      if (cell.dwidth_cont) // double-width cell continuation - drawn by left half
+         return;
+
+      bool dwidth = cell.dwidth;
+      if (dwidth && x < nCols - 1 && !cellBuf [idx + 1].dwidth_cont)
+         dwidth = false; // invalid without a continuation to the right
+
+      const int fontIdx = dwidth ? 0 : cell.bold | cell.italic << 1;
+
+      Color fg = cell.fg;
+      Color bg = cell.bg;
+      if (cell.inverse != isSelected (x, y))
+         std::swap (fg, bg);
+
+      Color cr = cursor.color;
+      if (cr == bg)
+         cr = Color {(uint8_t)(255 - cr.red), (uint8_t)(255 - cr.green),
+                     (uint8_t)(255 - cr.blue)};
+
+      using CS = Cursor::Style;
+      const bool atCursor = x == cursor.posX && y == cursor.posY;
+      if (atCursor && cursor.style == CS::filled_block)
+      {
+         fg = bg;
+         bg = cr;
+      }
+
+      const uint32_t fgPx = pack (fg);
+      const uint32_t bgPx = pack (bg);
+
+      // Clip to the view as well as the frame buffer
+      const int cellW = dwidth ? 2 * px : px;
+      const int x0 = opts.border + x * px;
+      const int y0 = opts.border + y * py;
+      const int w = std::min ({cellW, opts.border + nCols * px - x0,
+                               pxWidth - x0});
+      const int h = std::min ((int)py, pxHeight - y0);
+      if (w <= 0 || h <= 0)
+         return;
+
+      uint32_t* const dst = pixels + y0 * stride + x0;
+
+      if (!dwidth || hasDoubleWidth)
+      {
+         const FontAtlas& fa = dwidth ? layer_dw : layer [fontIdx];
+         const GlyphAtlas::Pos ap =
+            (dwidth ? atlas_dw : atlas)->getMap () [cell.uc_pt];
+         const uint8_t* src = fa.data + ap.y * py * fa.stride + ap.x * cellW;
+         const bool synth = synthStyles && fontIdx != 0;
+         uint32_t* out = dst;
+         for (int k = 0; k < h; ++k, out += stride, src += fa.stride)
+         {
+            const uint32_t rowBg = cell.underline
+                                 ? blend (bgPx, fgPx, fa.ulLumi [k])
+                                 : bgPx;
+            if (synth)
+            {
+               synthRow (alpha, src, w, px, k, fontIdx, italicPivot);
+               blendRow (out, alpha, w, rowBg, fgPx);
+            }
+            else
+            {
+               blendRow (out, src, w, rowBg, fgPx);
+            }
+         }
+      }
+      else
+      {  // no double-width font -- draw an empty box
+         const uint32_t boxPx = blend (bgPx, fgPx, 179); // 70%
+         uint32_t* out = dst;
+         for (int k = 0; k < h; ++k, out += stride)
+         {
+            std::fill_n (out, w, bgPx);
+            if (k < 1 || k > py - 2)
+               continue;
+            for (int j = 1; j < std::min (w, cellW - 1); ++j)
+               if (j == 1 || j == cellW - 2 || k == 1 || k == py - 2)
+                  out [j] = boxPx;
+         }
+      }
+
+      auto plot =
+         [&] (int j, int k, uint32_t pixel)
+         {
+            if (j < w && k < h)
+               dst [k * stride + j] = pixel;
+         };
+
+      if (opts.showWraps && cell.wrap)
+      {
+         for (int k = 0; k < py; k += 2)
+            plot (cellW - 1, k, fgPx);
+      }
+
+      if (atCursor)
+      {
+         const uint32_t crPx = pack (cr);
+         switch (cursor.style)
+         {
+         case CS::hollow_block:
+            for (int j = 0; j < cellW; j++)
+            {
+               plot (j, 0, crPx);
+               plot (j, py - 1, crPx);
+            }
+            for (int k = 1; k < py - 1; k++)
+            {
+               plot (0, k, crPx);
+               plot (cellW - 1, k, crPx);
+            }
+            break;
+         case CS::underline:
+            for (int j = 0; j < cellW; j++)
+            {
+               plot (j, py - 2, crPx);
+               plot (j, py - 1, crPx);
+            }
+            break;
+         case CS::bar:
+            for (int k = 0; k < py; k++)
+            {
+               plot (0, k, crPx);
+               plot (1, k, crPx);
+            }
+            break;
+         default:
+            break;
+         }
+      }
+   }
+
+   void
+   SoftCharVdev::workerThread ()
+   {
+      std::unique_lock <std::mutex> lk (workMx);
+      uint64_t seq = workSeq;
+      while (1)
+      {
+         workCond.wait (lk, [&] () { return workDone || workSeq != seq; });
+         if (workDone)
+            return;
+         seq = workSeq;
+         drawBands (lk);
+      }
+   }
+
+} // namespace zutty
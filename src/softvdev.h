@@ -0,0 +1,111 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "charvdev.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zutty
+{
+   /* CharVdev rendering on the CPU, for systems without a GPU capable of
+    * running the compute shader of GLCharVdev. The output is the same:
+    * glyphs are blended from the font atlases into an in-memory frame
+    * buffer, only redrawing the cells that have changed. Rows are split
+    * into bands rendered in parallel by a pool of worker threads, if
+    * there are enough cells to draw for that to pay off.
+    *
+    * If constructed with a window, draw () also presents the damaged part
+    * of the frame buffer in it, via MIT-SHM if available (falling back to
+    * plain XPutImage otherwise, e.g. on a remote display).
+    */
+   class SoftCharVdev: public CharVdev
+   {
+   public:
+      explicit SoftCharVdev (Fontpack* fontpk, unsigned long window = 0);
+
+      ~SoftCharVdev ();
+
+      bool resize (uint16_t pxWidth_, uint16_t pxHeight_) override;
+      void draw () override;
+
+      void setCursor (const Cursor& cursor) override;
+      void setSelection (const Rect& selection) override;
+      void setDeltaFrame (bool delta) override;
+
+      // The frame buffer (pixels in native byte order, 0x00RRGGBB unless
+      // presenting to a visual with a different layout)
+      const uint32_t* getPixels () const { return pixels; };
+      int getStride () const { return stride; }; // in pixels
+
+   private:
+      struct FontAtlas
+      {
+         const uint8_t* data = nullptr;
+         int stride = 0; // atlas width in pixels
+         std::vector <uint8_t> ulLumi; // underline intensity per glyph row
+      };
+      FontAtlas layer [4]; // Regular, Bold, Italic, BoldItalic
+      FontAtlas layer_dw;
+      bool hasDoubleWidth = false;
+
+      std::vector <Cell> cellBuf;
+
+      uint32_t* pixels = nullptr;
+      int stride = 0;
+      Point capacity {0, 0}; // allocated size of the frame buffer in pixels
+      std::vector <uint32_t> pixelBuf; // unless the buffer is in SHM
+      int rShift = 16, gShift = 8, bShift = 0;
+
+      Cursor cursor;
+      Point prevCursorPos {0, 0};
+      Rect selection;
+      int selectDamageStart = 0;
+      int selectDamageEnd = 0;
+      bool deltaFrame = false;
+
+      // Rows with cells to be drawn in the current frame
+      std::vector <uint16_t> drawRows;
+
+      // Scratch space for a synthesized glyph row (2 * px) per band
+      std::vector <uint8_t> alphaBuf;
+
+      struct Presenter;
+      std::unique_ptr <Presenter> presenter;
+
+      // Worker threads rendering bands of drawRows
+      std::vector <std::thread> workers;
+      std::mutex workMx;
+      std::condition_variable workCond;
+      std::condition_variable doneCond;
+      uint64_t workSeq = 0;
+      int nBands = 0;
+      int nextBand = 0;
+      int bandsDone = 0;
+      bool workDone = false;
+
+      Cell * mapCells () override;
+      void unmapCells () override;
+
+      uint32_t pack (const Color& c) const;
+      bool isCellDamaged (uint16_t x, uint16_t y) const;
+      bool isSelected (uint16_t x, uint16_t y) const;
+      void drawBands (std::unique_lock <std::mutex>& lk);
+      void drawRow (uint16_t y, uint8_t* alpha);
+      void drawCell (uint16_t x, uint16_t y, uint8_t* alpha);
+      void workerThread ();
+   };
+
+} // namespace zutty
@@ -13,8 +13,12 @@
 #include "pty.h"
 #include "vterm.h"
 
+#include <cerrno>
 #include <cstring>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace
 {
    using namespace zutty;
@@ -27,6 +31,17 @@ namespace
    // magic byte to act as a placeholder for the Modifier Code:
    #define MC "\xff"
 
+   // Time for the window size to settle before the pty is notified
+   const std::chrono::milliseconds ptyResizeDelay (50);
+
+   // Pending pty output is queued in chunks of (at most) this size, so
+   // that memory is released progressively as a large paste is written
+   constexpr const size_t ptyOutChunkSize = 64 * 1024;
+
+   // Terminal generated output (e.g. reports) is discarded instead of
+   // queued while this much is pending, i.e., the program is not reading
+   constexpr const size_t ptyOutMaxBacklog = 1024 * 1024;
+
    const InputSpec is_modOtherKeys2 [] =
    {
       {Key::K2,          CSI "27;" MC ";50~"},
@@ -594,6 +609,10 @@ namespace zutty
       , nColsEff (nCols)
       , hMargin (0)
    {
+      // Writes must not block, so that pasting a large amount of text to
+      // a program slow to read it does not hold up the event loop.
+      fcntl (ptyFd, F_SETFL, fcntl (ptyFd, F_GETFL) | O_NONBLOCK);
+
       makePalette256 (palette256);
 
       defaultFgPalIx = (opts.fg == palette256 [15]) ? 15 : -1;
@@ -640,32 +659,17 @@ namespace zutty
       }
 
       hideCursor ();
+      predictReset ();
 
       if (altScreenBufferMode)
       {
-         frame_alt = Frame (winPx, winPy, nCols_, nRows_,
-                            marginTop, marginBottom);
+         frame_alt.reset (winPx, winPy, nCols_, nRows_,
+                          marginTop, marginBottom);
       }
       else
       {
-         if (nRows_ < posY + 1)
-         {
-            int nScroll = nRows - nRows_;
-            cf->scrollUp (nScroll);
-            posY -= nScroll;
-         }
-
          frame_pri.resize (winPx, winPy, nCols_, nRows_,
-                           marginTop, marginBottom);
-
-         if (nRows < nRows_)
-         {
-            int nScroll = std::min (nRows_ - nRows, (int)cf->getHistoryRows ());
-            cf->scrollDown (nScroll);
-            posY += nScroll;
-         }
-
-         frame_alt.freeCells ();
+                           marginTop, marginBottom, posX, posY);
       }
       nCols = nCols_;
       nRows = nRows_;
@@ -683,7 +687,77 @@ namespace zutty
       normalizeCursorPos ();
       showCursor ();
 
+      if (search.active)
+      {
+         // Rows have been reflowed, the snapshot is no longer valid
+         search.snapshot = nullptr;
+         searchRestart ();
+      }
+
+      // Defer notifying the application (via SIGWINCH), so that it does
+      // not redraw for each step while the window is being resized.
+      ptyResizeDue = std::chrono::steady_clock::now () + ptyResizeDelay;
+      ptyResizePending = true;
+   }
+
+   int
+   Vterm::flushPtyResize ()
+   {
+      using namespace std::chrono;
+
+      if (!ptyResizePending)
+         return -1;
+
+      auto now = steady_clock::now ();
+      if (now < ptyResizeDue)
+         return duration_cast <milliseconds> (ptyResizeDue - now).count () + 1;
+
       pty_resize (ptyFd, nCols, nRows);
+      ptyResizePending = false;
+
+      // The size has settled; free the storage kept for further resizes
+      frame_pri.releaseSpareCells ();
+      frame_alt.releaseSpareCells ();
+      return -1;
+   }
+
+   int
+   Vterm::expirePredictions ()
+   {
+      const int timeout = predictor.expire ();
+      if (predictShown && !predictor.isShown ())
+      {
+         predictUpdate ();
+         showCursor ();
+         redraw ();
+      }
+      return timeout;
+   }
+
+   // Put the predictions of local echo (if any) on the frame overlay.
+   // They are only shown in the live view, and the overlay is left alone
+   // unless it carries predictions, since search also makes use of it.
+   void
+   Vterm::predictUpdate ()
+   {
+      const bool show = predictor.isShown () && !search.active &&
+                        cf->getViewOffset () == 0;
+      if (!show && !predictShown)
+         return;
+
+      Frame::Overlay overlay;
+      predictCursor = Point (posX, posY);
+      if (show)
+         predictor.getOverlay (overlay, predictCursor);
+      cf->setOverlay (std::move (overlay));
+      predictShown = show;
+   }
+
+   void
+   Vterm::predictReset ()
+   {
+      predictor.reset ();
+      predictUpdate ();
    }
 
    std::string
@@ -832,10 +906,110 @@ namespace zutty
          return len;
       }
 
+      if (!userInput && ptyOutQueued > ptyOutMaxBacklog)
+      {
+         logW << "pty write: discarding, output backlog is "
+              << ptyOutQueued << " bytes" << std::endl;
+         return len;
+      }
+
       logT << "pty write: " << dumpBuffer (ucstr, ucstr + len);
       if (userInput && localEcho)
          processInput (getLocalEcho (ucstr, ucstr + len));
-      return write (ptyFd, ucstr, len);
+      else if (userInput && opts.predictEcho)
+      {
+         if (cf->getViewOffset ())
+            predictor.reset ();
+         else
+            predictor.input (ucstr, len, *cf, posX, posY, attrs);
+         if (predictShown || predictor.isShown ())
+         {
+            predictUpdate ();
+            showCursor ();
+            redraw ();
+         }
+      }
+
+      // Keep the order of output: anything queued goes first
+      size_t written = 0;
+      if (ptyOutQueue.empty ())
+      {
+         ssize_t n = writePtyNonBlocking (ucstr, len);
+         if (n < 0)
+            return n;
+         written = n;
+      }
+      queuePtyOutput (ucstr + written, len - written);
+      return len;
+   }
+
+   bool
+   Vterm::flushPtyOutput ()
+   {
+      while (!ptyOutQueue.empty ())
+      {
+         const std::string& chunk = ptyOutQueue.front ();
+         const size_t len = chunk.size () - ptyOutPos;
+         ssize_t n = writePtyNonBlocking (
+            (const uint8_t*)chunk.data () + ptyOutPos, len);
+         if (n < 0)
+            return true;
+
+         ptyOutQueued -= n;
+         if ((size_t)n < len)
+         {
+            ptyOutPos += n;
+            break; // the pty is full
+         }
+         ptyOutQueue.pop_front ();
+         ptyOutPos = 0;
+      }
+      logT << "pty output pending: " << ptyOutQueued << " bytes" << std::endl;
+      return false;
+   }
+
+   // Write as much as the pty takes without blocking; -1 on error
+   ssize_t
+   Vterm::writePtyNonBlocking (const uint8_t* buf, size_t len)
+   {
+      size_t written = 0;
+      while (written < len)
+      {
+         ssize_t n = write (ptyFd, buf + written, len - written);
+         if (n >= 0)
+            written += n;
+         else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+         else if (errno != EINTR)
+         {
+            logE << "pty write: " << strerror (errno) << std::endl;
+            return -1;
+         }
+      }
+      return written;
+   }
+
+   void
+   Vterm::queuePtyOutput (const uint8_t* buf, size_t len)
+   {
+      if (!len)
+         return;
+
+      ptyOutQueued += len;
+      while (len)
+      {
+         if (ptyOutQueue.empty () ||
+             ptyOutQueue.back ().size () == ptyOutChunkSize)
+         {
+            ptyOutQueue.emplace_back ();
+            ptyOutQueue.back ().reserve (ptyOutChunkSize);
+         }
+         std::string& chunk = ptyOutQueue.back ();
+         const size_t n = std::min (len, ptyOutChunkSize - chunk.size ());
+         chunk.append ((const char*)buf, n);
+         buf += n;
+         len -= n;
+      }
    }
 
    using Key = VtKey;
@@ -1022,7 +1196,11 @@ namespace zutty
       lastNormalBegin = 0;
       lastStopPos = 0;
       hideCursor ();
-      cf->pageToBottom ();
+      // While searching, the view stays with the match being shown
+      Frame* const frame = cf;
+      const int64_t scrollPos = cf->getScrollPos ();
+      if (!search.active)
+         cf->pageToBottom ();
       for (readPos = 0; readPos < inputSize; ++readPos)
       {
          const unsigned char& ch = input [readPos];
@@ -1424,6 +1602,20 @@ namespace zutty
          }
       }
       traceNormalInput ();
+      if (search.active && cf == frame)
+      {
+         // Follow the rows scrolled up (or down) by the output
+         const int64_t delta = cf->getScrollPos () - scrollPos;
+         if (delta > 0)
+            cf->pageUp (std::min <int64_t> (delta, cf->getHistoryRows ()));
+         else if (delta < 0)
+            cf->pageDown (std::min <int64_t> (-delta, cf->getViewOffset ()));
+      }
+      if (opts.predictEcho)
+      {
+         predictor.check (*cf, posX, posY);
+         predictUpdate ();
+      }
       showCursor ();
       redraw ();
    }
@@ -1506,6 +1698,7 @@ namespace zutty
       Point pt (pX / glyphPx, pY / glyphPy);
 
       Rect& selection = cf->getSelection ();
+      const Rect prevSelection = selection;
 
       if (selection.rectangular)
       {
@@ -1572,18 +1765,23 @@ namespace zutty
             selection.br = pt;
          }
       }
+
+      // Motion within a cell does not change the selection
+      if (selection.tl == prevSelection.tl && selection.br == prevSelection.br)
+         return;
       redraw ();
    }
 
    bool
-   Vterm::selectFinish (std::string& utf8_selection)
+   Vterm::selectFinish (std::shared_ptr <Frame::SelectedText>& selectedText)
    {
       logT << "selectFinish ()" << std::endl;
 
       showCursor ();
       redraw ();
 
-      return  cf->getSelectedUtf8 (utf8_selection);
+      selectedText = cf->getSelectedText ();
+      return selectedText != nullptr;
    }
 
    void
@@ -1605,19 +1803,331 @@ namespace zutty
    void
    Vterm::pasteSelection (const std::string& utf8_selection)
    {
-      std::ostringstream oss;
+      if (utf8_selection.empty ())
+         return;
+
+      // The whole paste goes to the output queue at once, so that other
+      // input is not interleaved with it, even in bracketed paste mode.
+      std::string paste;
+      paste.reserve (utf8_selection.size () + 12);
 
       if (bracketedPasteMode)
-         oss << "\e[200~";
+         paste.append ("\e[200~");
 
       for (const auto ch: utf8_selection)
-         oss << (ch == '\n' ? '\r' : ch);
+         paste.push_back (ch == '\n' ? '\r' : ch);
 
       if (bracketedPasteMode)
-         oss << "\e[201~";
+         paste.append ("\e[201~");
+
+      writePty ((const uint8_t*)paste.data (), paste.size (), true);
+   }
+
+   // Scroll the view to the previous (or next) prompt above (or below) its top
+   void
+   Vterm::jumpToPrompt (bool previous)
+   {
+      if (altScreenBufferMode || search.active)
+         return;
+
+      int row;
+      if (!cf->findMark (Frame::Mark::PromptStart, -cf->getViewOffset (),
+                         previous, row))
+         return;
+
+      logT << "jumpToPrompt: row " << row << std::endl;
+      cf->pageToRow (row);
+      redraw ();
+   }
+
+   /* Select the output of the command at the top of the view (or the first
+    * one below it): the rows from its output start mark up to the command
+    * end or the next prompt, whichever comes first. If the command is still
+    * running, the output extends to the cursor.
+    */
+   bool
+   Vterm::selectCommandOutput (
+      std::shared_ptr <Frame::SelectedText>& selectedText)
+   {
+      if (altScreenBufferMode || search.active)
+         return false;
+
+      using Mark = Frame::Mark;
+      int start;
+      if (!cf->findMark (Mark::OutputStart, -cf->getViewOffset () - 1,
+                         false, start))
+         return false;
+
+      int end = posY + 1;
+      int next;
+      if (cf->findMark (Mark::CommandEnd, start - 1, false, next))
+         end = std::min (end, next);
+      if (cf->findMark (Mark::PromptStart, start - 1, false, next))
+         end = std::min (end, next);
+      if (end <= start)
+         return false;
+
+      logT << "selectCommandOutput: rows " << start << " to " << end
+           << std::endl;
+      cf->pageToRow (start);
+      const int viewOffset = cf->getViewOffset ();
+      cf->setSelectSnapTo (Frame::SelectSnapTo::Char);
+      cf->getSelection () = Rect (0, start + viewOffset, 0, end + viewOffset);
+      redraw ();
 
-      if (oss.str ().size ())
-         writePty (oss.str ().c_str (), true);
+      selectedText = cf->getSelectedText ();
+      return selectedText != nullptr;
+   }
+
+   void
+   Vterm::searchStart ()
+   {
+      if (search.active)
+         return;
+
+      if (altScreenBufferMode)
+      {
+         logT << "Search is not available on the alternate screen" << std::endl;
+         return;
+      }
+
+      logT << "searchStart ()" << std::endl;
+      predictReset ();
+      if (!searchEngine)
+         searchEngine = std::make_unique <SearchEngine> ();
+
+      search = SearchState ();
+      search.active = true;
+      hideCursor ();
+      searchRestart ();
+   }
+
+   void
+   Vterm::searchEnd ()
+   {
+      if (!search.active)
+         return;
+
+      logT << "searchEnd ()" << std::endl;
+      searchEngine->cancel ();
+      search = SearchState ();
+      cf->setOverlay (Frame::Overlay ());
+      cf->getSelection ().clear ();
+      showCursor ();
+      redraw ();
+   }
+
+   void
+   Vterm::searchInput (const char* utf8)
+   {
+      Utf8Decoder dec ([&] ()
+                       {
+                          uint32_t cp = dec.getUnicode ();
+                          if (cp >= ' ' && cp < 0x10000)
+                             search.pattern.push_back (cp);
+                       });
+      for (const unsigned char* p = (const unsigned char*)utf8; *p; ++p)
+      {
+         if (*p < 0x80) // N.B.: not handled by pushByte ()
+            dec.onUnicode (*p);
+         else
+            dec.pushByte (*p);
+      }
+      searchRestart ();
+   }
+
+   void
+   Vterm::searchErase ()
+   {
+      if (search.pattern.empty ())
+         return;
+
+      search.pattern.pop_back ();
+      searchRestart ();
+   }
+
+   void
+   Vterm::searchToggleRegex ()
+   {
+      search.regex = !search.regex;
+      searchRestart ();
+   }
+
+   /* Move to the next match above (older) or below the current one. If
+    * there is no current match yet, start from the bottom of the view.
+    */
+   void
+   Vterm::searchNext (bool older)
+   {
+      if (search.matches.empty ())
+         return;
+
+      SearchMatch ref = search.current;
+      if (!search.hasCurrent)
+         ref = SearchMatch {nRows - cf->getViewOffset () + searchRowOffset (),
+                            0, 0};
+
+      auto it = search.matches.end ();
+      if (older)
+      {
+         it = search.matches.lower_bound (ref);
+         if (it == search.matches.begin ())
+            return;
+         --it;
+      }
+      else
+      {
+         it = search.matches.upper_bound (ref);
+         if (it == search.matches.end ())
+            return;
+      }
+
+      if (it->row - searchRowOffset () < -cf->getHistoryRows ())
+         return; // already dropped from the scrollback history
+
+      search.current = *it;
+      search.hasCurrent = true;
+      searchShowMatch (search.current);
+      redraw ();
+   }
+
+   void
+   Vterm::searchFetchResults ()
+   {
+      if (!search.active)
+         return;
+
+      std::vector <SearchMatch> found;
+      search.state = searchEngine->fetchResults (found);
+      search.matches.insert (found.begin (), found.end ());
+
+      if (!search.hasCurrent && !search.matches.empty ())
+      {
+         searchNext (true);
+         if (!search.hasCurrent)
+            searchNext (false);
+      }
+      searchUpdatePrompt ();
+   }
+
+   // private methods
+
+   // Offset to add to current frame rows to get snapshot rows
+   int
+   Vterm::searchRowOffset () const
+   {
+      if (!search.snapshot)
+         return 0;
+      return cf->getScrollPos () - search.snapshot->scrollPos;
+   }
+
+   void
+   Vterm::searchRestart ()
+   {
+      searchEngine->cancel ();
+      search.matches.clear ();
+      search.hasCurrent = false;
+      cf->getSelection ().clear ();
+
+      if (search.pattern.empty ())
+      {
+         search.state = SearchEngine::State::Idle;
+         searchUpdatePrompt ();
+         return;
+      }
+
+      if (!search.snapshot)
+      {
+         // Taken once for the whole search session, so that editing the
+         // pattern does not copy the history again.
+         auto snap = std::make_shared <TextSnapshot> ();
+         snap->nCols = nCols;
+         snap->firstRow = -cf->getHistoryRows ();
+         snap->scrollPos = cf->getScrollPos ();
+         const int count = nRows - snap->firstRow;
+         snap->text.resize (count * nCols);
+         cf->copyText (snap->firstRow, count, snap->text.data (),
+                       TextSnapshot::DWidthCont);
+         search.snapshot = std::move (snap);
+      }
+
+      int originRow = -cf->getViewOffset () + searchRowOffset ();
+      searchEngine->start (search.snapshot, search.pattern, search.regex,
+                           originRow);
+      search.state = SearchEngine::State::Running;
+      searchUpdatePrompt ();
+   }
+
+   // Scroll the view to show the match (if needed) and select it
+   void
+   Vterm::searchShowMatch (const SearchMatch& match)
+   {
+      const int row = match.row - searchRowOffset ();
+      const int viewTop = -cf->getViewOffset ();
+
+      // The bottom row of the view is covered by the prompt
+      if (row < viewTop || row >= viewTop + nRows - 1)
+      {
+         int viewOffset = std::max (0, std::min (nRows / 2 - row,
+                                                 (int)cf->getHistoryRows ()));
+         int delta = viewOffset - cf->getViewOffset ();
+         if (delta > 0)
+            cf->pageUp (delta);
+         else if (delta < 0)
+            cf->pageDown (-delta);
+      }
+
+      const int y = row + cf->getViewOffset ();
+      cf->setSelectSnapTo (Frame::SelectSnapTo::Char);
+      cf->getSelection () = Rect (match.col, y, match.col + match.length, y);
+   }
+
+   // Show the search prompt and status in the bottom row of the view
+   void
+   Vterm::searchUpdatePrompt ()
+   {
+      std::ostringstream oss;
+      switch (search.state)
+      {
+      case SearchEngine::State::Idle:
+         break;
+      case SearchEngine::State::Running:
+         oss << "[" << search.matches.size () << " matches, searching...]";
+         break;
+      case SearchEngine::State::Done:
+         if (search.matches.empty ())
+            oss << "[no match]";
+         else
+            oss << "[" << search.matches.size () << " matches]";
+         break;
+      case SearchEngine::State::Error:
+         oss << "[invalid regex]";
+         break;
+      }
+      const std::string status = oss.str ();
+
+      std::u16string text = search.regex ? u"Regex: " : u"Search: ";
+      text += search.pattern;
+      const int statusStart = std::max (0, nCols - (int)status.size ());
+      const int avail = std::max (0, statusStart - 1);
+      if ((int)text.size () > avail)
+         text.erase (0, text.size () - avail); // keep the end in view
+
+      Frame::Overlay overlay;
+      overlay.reserve (nCols);
+      CharVdev::Cell c;
+      c.inverse = 1;
+      for (uint16_t x = 0; x < nCols; ++x)
+      {
+         c.uc_pt = ' ';
+         if (x < text.size ())
+            c.uc_pt = text [x];
+         else if (x >= statusStart)
+            c.uc_pt = status [x - statusStart];
+         overlay.push_back ({(uint16_t)(nRows - 1), x, c});
+      }
+      cf->setOverlay (std::move (overlay));
+      redraw ();
    }
 
 } // namespace zutty
@@ -12,11 +12,16 @@
 #pragma once
 
 #include "frame.h"
+#include "predict.h"
+#include "search.h"
 #include "utf8.h"
 
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <set>
 
 namespace zutty
 {
@@ -95,7 +100,17 @@ namespace zutty
 
       void resize (uint16_t winPx, uint16_t winPy);
 
-      void redraw ();
+      // Discard predictions not confirmed in time (see EchoPredictor).
+      // Returns the number of milliseconds until the next is due, or -1.
+      int expirePredictions ();
+
+      // Report a pending size change to the pty once resizing has settled.
+      // Returns the number of milliseconds until it is due, or -1 if none.
+      int flushPtyResize ();
+
+      // Hand the current frame to the renderer; with full, to be rendered
+      // in whole, as the window contents have been lost (e.g. on Expose)
+      void redraw (bool full = false);
 
       // mapping of a certain VtKey to a sequence of input characters
       struct InputSpec
@@ -118,9 +133,15 @@ namespace zutty
 
       bool readPty ();
 
+      // Output that the pty did not take right away is queued, to be
+      // written when the pty becomes writable. Returns true on error.
+      bool hasPtyOutput () const { return !ptyOutQueue.empty (); }
+      bool flushPtyOutput ();
+
       const MouseTrackingState& getMouseTrackingState () const;
 
       void setHasFocus (bool);
+      void setVisible (bool);
       void mouseWheelUp ();
       void mouseWheelDown ();
       void pageUp ();
@@ -129,12 +150,28 @@ namespace zutty
       void selectStart (int pX, int pY, bool cycleSnapTo);
       void selectExtend (int pX, int pY, bool cycleSnapTo);
       void selectUpdate (int pX, int pY);
-      bool selectFinish (std::string& utf8_selection);
+      bool selectFinish (std::shared_ptr <Frame::SelectedText>& selectedText);
       void selectClear ();
       void selectRectangularModeToggle ();
 
       void pasteSelection (const std::string& utf8_selection);
 
+      // Navigation by shell integration (OSC 133) marks
+      void jumpToPrompt (bool previous);
+      bool selectCommandOutput (
+         std::shared_ptr <Frame::SelectedText>& selectedText);
+
+      // Scrollback search mode (on the primary screen)
+      void searchStart ();
+      void searchEnd ();
+      bool isSearchActive () const;
+      void searchInput (const char* utf8);
+      void searchErase ();
+      void searchToggleRegex ();
+      void searchNext (bool older);
+      int getSearchFd () const;
+      void searchFetchResults ();
+
    private:
       std::string getLocalEcho (const unsigned char *const begin,
                                 const unsigned char *const end);
@@ -142,6 +179,8 @@ namespace zutty
       void processInput (const std::string& str);
 
       int writePty (const uint8_t* ucstr, size_t len, bool userInput = false);
+      ssize_t writePtyNonBlocking (const uint8_t* buf, size_t len);
+      void queuePtyOutput (const uint8_t* buf, size_t len);
 
       // table entry for deciding which set of InputSpecs to use
       struct InputSpecTable
@@ -314,6 +353,7 @@ namespace zutty
 
       void osc_PaletteQuery (int, const std::string&);
       void osc_DynamicColorQuery (int, const std::string&);
+      void osc_ShellIntegration (const std::string&);
 
       uint16_t winPx;
       uint16_t winPy;
@@ -322,6 +362,11 @@ namespace zutty
       uint16_t glyphPx;
       uint16_t glyphPy;
       int ptyFd;
+      bool ptyResizePending = false;
+      std::chrono::steady_clock::time_point ptyResizeDue;
+      std::deque <std::string> ptyOutQueue; // chunks of pending output
+      size_t ptyOutPos = 0;    // number of bytes written of the first chunk
+      size_t ptyOutQueued = 0; // total number of bytes pending
 
       RefreshHandlerFn onRefresh;
       OscHandlerFn onOsc;
@@ -351,6 +396,8 @@ namespace zutty
       int bgPalIx;
       bool reverseVideo = false;
       bool hasFocus = false;
+      bool visible = true; // nothing is rendered while false
+      bool fullRedraw = false; // requested via redraw (), not yet done
 
       unsigned char inputBuf [32 * 1024];
       int readPos = 0;
@@ -458,6 +505,32 @@ namespace zutty
       bool selectUpdatesTop = false;
       bool selectUpdatesLeft = false;
 
+      struct SearchState
+      {
+         bool active = false;
+         bool regex = false;
+         std::u16string pattern;
+         std::shared_ptr <TextSnapshot> snapshot = nullptr;
+         std::set <SearchMatch> matches;  // in snapshot coordinates
+         SearchMatch current {0, 0, 0};
+         bool hasCurrent = false;
+         SearchEngine::State state = SearchEngine::State::Idle;
+      };
+      SearchState search;
+      std::unique_ptr <SearchEngine> searchEngine = nullptr;
+
+      // Predictive local echo
+      EchoPredictor predictor;
+      bool predictShown = false; // are predictions on the frame overlay?
+      Point predictCursor;       // predicted cursor position, if shown
+      void predictUpdate ();
+      void predictReset ();
+
+      int searchRowOffset () const;
+      void searchRestart ();
+      void searchShowMatch (const SearchMatch& match);
+      void searchUpdatePrompt ();
+
       MouseTrackingState mouseTrk;
 
       #ifdef DEBUG
@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+
+cd $(dirname $0)
+source testbase.sh
+
+export VERIFY_SNAPS=no # Override profile setting
+
+CHECK_DEPS dc
+OPS="ED EL ECH ICH DCH IL DL"
+COUNT=20000
+TIMES=20
+
+echo "Timing streams of erase/insert/delete sequences." > ${TEST_LOG}
+echo "Sequences per stream: ${COUNT}" >> ${TEST_LOG}
+echo "Repeated: ${TIMES} times" >> ${TEST_LOG}
+
+# Pre-generate the streams so their generation is not part of the timing
+for op in ${OPS} ; do
+    bash erase_bench_inc.sh ${op} ${COUNT} > ${UUT_SNAP}/erase_bench_${op}.vt
+done
+
+for op in ${OPS} ; do
+    TIME_STREAM ${UUT_SNAP}/erase_bench_${op}.vt ${COUNT} ${TIMES}
+    echo "${op}: ${REAL_SECS} secs, ${RATE} sequences/sec" >> ${TEST_LOG}
+done
+
+cat ${TEST_LOG}
@@ -0,0 +1,28 @@
+# Generate a stream of editing sequences of one kind, for erase_bench.sh
+# Usage: erase_bench_inc.sh <ED|EL|ECH|ICH|DCH|IL|DL> <count>
+
+OP=$1
+COUNT=$2
+
+# Seed the screen with content so there is something to move around
+printf "\e[H"
+for r in {1..24} ; do
+    printf "%0*d" 80 0 | tr 0 "$(printf "\\$(printf %o $((64 + r)))")"
+done
+
+for i in $(seq 1 ${COUNT}) ; do
+    row=$((1 + i % 24))
+    col=$((1 + (i * 7) % 80))
+    case ${OP} in
+        ED)  printf "\e[%d;%dH\e[%dJ" ${row} ${col} $((i % 3)) ;;
+        EL)  printf "\e[%d;%dH\e[%dK" ${row} ${col} $((i % 3)) ;;
+        ECH) printf "\e[%d;%dH\e[%dX" ${row} ${col} $((1 + i % 80)) ;;
+        ICH) printf "\e[%d;%dH\e[%d@" ${row} ${col} $((1 + i % 40)) ;;
+        DCH) printf "\e[%d;%dH\e[%dP" ${row} ${col} $((1 + i % 40)) ;;
+        IL)  printf "\e[%d;1H\e[%dL" ${row} $((1 + i % 12)) ;;
+        DL)  printf "\e[%d;1H\e[%dM" ${row} $((1 + i % 12)) ;;
+    esac
+    # Repaint a row to keep the moves from degenerating to blanks
+    printf "\e[%d;1H%s" $((1 + (i * 5) % 24)) "The quick brown fox jumps over"
+done
+printf "\e[H\e[J"
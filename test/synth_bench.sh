@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+
+cd $(dirname $0)
+
+# Compare the real Bold, Italic and Bold Italic variants of a font with
+# the ones synthesized from Regular (-synthStyles): font load time and
+# glyph atlas size (as logged by the UUT on startup), and the time it
+# takes to render a stream of text in these styles.
+#
+# Like fonts.sh, this starts a new UUT instance for each setting, and
+# needs a font with all four variants present; by default, DejaVu Sans
+# Mono (package: fonts-dejavu-core). Set FONT to use another one.
+#
+# N.B.: the timing covers the whole terminal (parsing, rendering and
+# presentation), so only a difference in shading cost large enough to
+# slow down the UUT will show.
+
+FONT=${FONT:-DejaVuSansMono}
+
+for synth in "+synthStyles" "-synthStyles" ; do
+    export UUT_ARGS="-font ${FONT} ${synth}"
+    ./synth_benchtest.sh "$@" || exit 1
+done
@@ -0,0 +1,10 @@
+# Generate a stream of text in bold, italic and bold italic, for synth_bench.sh
+# Usage: synth_bench_inc.sh <count>
+
+COUNT=$1
+
+TEXT="The quick brown fox jumps over the lazy dog 0123456789 ()[]{}<>/\\|@#"
+for i in $(seq 1 ${COUNT}) ; do
+    printf "\e[1m%s\e[22;3m%s\e[1m%s\e[m\n" "${TEXT:0:24}" "${TEXT:24:24}" \
+           "${TEXT:48}"
+done
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+cd $(dirname $0)
+source testbase.sh
+
+export VERIFY_SNAPS=no # Override profile setting
+
+CHECK_DEPS dc
+COUNT=5000
+TIMES=10
+
+STREAM=${UUT_SNAP}/synth_bench.vt
+
+# Pre-generate the stream so its generation is not part of the timing
+bash synth_bench_inc.sh ${COUNT} > ${STREAM}
+
+echo "Timing streams of bold/italic text with: ${UUT_ARGS}" > ${TEST_LOG}
+echo "Lines per stream: ${COUNT}" >> ${TEST_LOG}
+echo "Repeated: ${TIMES} times" >> ${TEST_LOG}
+grep -e "variant in" -e "Glyph atlas:" ${UUT_LOG} | sed -e 's/^.*\] //' \
+    >> ${TEST_LOG}
+
+TIME_STREAM ${STREAM} ${COUNT} ${TIMES}
+echo "Stream: ${REAL_SECS} secs, ${RATE} lines/sec" >> ${TEST_LOG}
+
+cat ${TEST_LOG}
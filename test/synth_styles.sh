@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+
+cd $(dirname $0)
+
+# Check that the italic synthesized with -synthStyles only slants the
+# glyphs, without pushing any of their ink out of the cell: each cell of
+# a line printed in italic must carry exactly as much ink as the same
+# cell of the line printed upright. Bold italic must carry at least as
+# much ink as bold (which loses the widened stroke of glyphs reaching
+# the right edge, whereas bold italic might slant it back into the cell).
+#
+# The glyphs are chosen to have ink up to the left and right edges of
+# the cell, on rows far above and below the middle.
+#
+# This test runs the UUT headless (as it needs no X server, nor the
+# usual snapshot tools), so it is *not* part of run-ci, but it should be
+# run manually whenever touching synthGlyph () in compute.glsl or
+# synthRow () in softvdev.cc (which do exactly the same).
+#
+# Fonts can be chosen by setting UUT_ARGS (see fonts.sh), and another
+# binary by setting UUT_EXE.
+
+UUT_EXE=${UUT_EXE:-../build/src/zutty}
+UUT_ARGS=${UUT_ARGS:-"-font DejaVuSansMono"}
+TEXT='MW@#&|/_dbhklfjgqyTVAXm[]{}()'
+
+for dep in od awk ; do
+    if ! which ${dep} >/dev/null 2>&1 ; then
+        echo "Missing dependency: ${dep}"
+        exit 1
+    fi
+done
+if [ ! -x "${UUT_EXE}" ] ; then
+    echo "Missing executable: ${UUT_EXE}"
+    exit 1
+fi
+
+OUT="$(pwd)/output/synth_styles"
+rm -rf ${OUT}
+mkdir -p ${OUT}
+
+# Lines 0..3: regular, italic, bold, bold italic (with the cursor hidden)
+${UUT_EXE} ${UUT_ARGS} -synthStyles -border 0 -geometry 40x4 -v \
+           -headless ${OUT} -e sh -c \
+           "printf '\\e[?25l${TEXT}\\r\\n\\e[3m${TEXT}\\e[m\\r\\n\\e[1m${TEXT}\\e[m\\r\\n\\e[1;3m${TEXT}\\e[m\\e]999;synth.rgba\\a'" \
+           >${OUT}/uut.log 2>&1
+
+GLYPH_SIZE=$(sed -n -e 's/^.*Glyph size \([0-9]*\)x\([0-9]*\).*$/\1 \2/p' \
+                 ${OUT}/uut.log | head -1)
+if [ ! -f ${OUT}/synth.rgba ] || [ -z "${GLYPH_SIZE}" ] ; then
+    echo "No snapshot taken, see ${OUT}/uut.log"
+    exit 1
+fi
+set -- ${GLYPH_SIZE}
+
+# Sum the intensity (red channel) of each cell, and compare the lines
+od -An -v -tu1 -w4 ${OUT}/synth.rgba | \
+    awk -v px=$1 -v py=$2 -v cols=40 -v n=${#TEXT} '
+        {
+            x = (NR - 1) % (cols * px);
+            y = int ((NR - 1) / (cols * px));
+            ink [int (y / py), int (x / px)] += $1;
+        }
+        END {
+            errors = 0;
+            for (c = 0; c < n; ++c) {
+                if (ink [1, c] != ink [0, c]) {
+                    printf ("italic cell %d: ink %d, upright %d\n",
+                            c, ink [1, c], ink [0, c]);
+                    ++errors;
+                }
+                if (ink [3, c] < ink [2, c]) {
+                    printf ("bold italic cell %d: ink %d, bold %d\n",
+                            c, ink [3, c], ink [2, c]);
+                    ++errors;
+                }
+            }
+            exit (errors > 0);
+        }'
+if [ $? -ne 0 ] ; then
+    echo "FAIL: synthesized italic glyphs lose ink at the cell edges"
+    exit 1
+fi
+echo "PASS: synthesized italic glyphs keep all their ink"
@@ -364,3 +364,19 @@ function WAIT_FOR_DOT_COMPLETE {
     done
     rm -f .complete
 }
+
+# Time sending a (pre-generated) stream to the UUT a number of times, via
+# cat in its shell. Sets REAL_SECS to the time taken, and RATE to the
+# number of units (of which the stream holds count) sent per second.
+function TIME_STREAM {
+    local stream="$1"; shift
+    local count="$1"; shift
+    local times="$1"; shift
+    local time_log="${stream%.*}.time"
+
+    rm -f ${time_log}
+    IN "{ time -p for i in \$(seq 1 ${times}); do cat ${stream}; done } 2>${time_log} && touch .complete\r"
+    WAIT_FOR_DOT_COMPLETE
+    REAL_SECS=$(grep "^real" ${time_log} | awk '{print $2}')
+    RATE=$(dc -e "${count} ${times} * ${REAL_SECS} / p")
+}